@@ -0,0 +1,347 @@
+/**
+ * analysis.c
+ *
+ * Letter frequency analysis for recovering unknown cypher keys.
+ *
+ * Histograms are counted into four byte-indexed tables in turn, so that
+ * consecutive equal bytes do not stall on the same counter, and folded
+ * down to 26 letters at the end.
+ *
+ * Vigenere keys are recovered from letters packed one per byte as 0..25,
+ * which keeps the strided passes over them small and branch free.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analysis.h"
+
+// bytes counted before the 32 bit tables are folded into the totals
+#define HISTOGRAM_BLOCK ((size_t) 1 << 30)
+
+// smallest piece of text worth handing to a thread
+#define HISTOGRAM_MIN_PIECE (256 * 1024)
+
+// most threads letter_histogram_parallel will start
+#define HISTOGRAM_MAX_THREADS 256
+
+const double english_frequencies[26] = {
+    0.08167, 0.01492, 0.02782, 0.04253, 0.12702, 0.02228, 0.02015,
+    0.06094, 0.06966, 0.00153, 0.00772, 0.04025, 0.02406, 0.06749,
+    0.07507, 0.01929, 0.00095, 0.05987, 0.06327, 0.09056, 0.02758,
+    0.00978, 0.02360, 0.00150, 0.01974, 0.00074
+};
+
+void letter_histogram(const char *in, size_t len, uint64_t counts[26])
+{
+    const unsigned char *bytes = (const unsigned char *) in;
+    uint32_t tables[4][256];
+
+    for (size_t i = 0; i < len; )
+    {
+        size_t end = len - i < HISTOGRAM_BLOCK ? len : i + HISTOGRAM_BLOCK;
+        memset(tables, 0, sizeof(tables));
+
+        for (; i + 4 <= end; i += 4)
+        {
+            tables[0][bytes[i]]++;
+            tables[1][bytes[i + 1]]++;
+            tables[2][bytes[i + 2]]++;
+            tables[3][bytes[i + 3]]++;
+        }
+        for (; i < end; i++)
+        {
+            tables[0][bytes[i]]++;
+        }
+
+        // fold both cases of every letter from every table
+        for (int c = 0; c < 26; c++)
+        {
+            for (int t = 0; t < 4; t++)
+            {
+                counts[c] += tables[t]['a' + c] + tables[t]['A' + c];
+            }
+        }
+    }
+}
+
+// one thread's share of letter_histogram_parallel
+typedef struct
+{
+    const char *in;
+    size_t len;
+    uint64_t counts[26];
+}
+histogram_piece;
+
+/**
+ * Counts one piece into its private histogram.
+ */
+static void *histogram_worker(void *arg)
+{
+    histogram_piece *p = arg;
+    letter_histogram(p->in, p->len, p->counts);
+    return NULL;
+}
+
+void letter_histogram_parallel(const char *in, size_t len,
+    uint64_t counts[26], int threads)
+{
+    if (threads > HISTOGRAM_MAX_THREADS)
+    {
+        threads = HISTOGRAM_MAX_THREADS;
+    }
+    if ((size_t) threads > len / HISTOGRAM_MIN_PIECE)
+    {
+        threads = len / HISTOGRAM_MIN_PIECE;
+    }
+    if (threads <= 1)
+    {
+        letter_histogram(in, len, counts);
+        return;
+    }
+
+    histogram_piece pieces[HISTOGRAM_MAX_THREADS];
+    pthread_t tids[HISTOGRAM_MAX_THREADS];
+    bool started[HISTOGRAM_MAX_THREADS];
+
+    size_t piece_len = len / threads;
+    for (int i = 0; i < threads; i++)
+    {
+        pieces[i].in = in + i * piece_len;
+        pieces[i].len = i == threads - 1 ? len - i * piece_len : piece_len;
+        memset(pieces[i].counts, 0, sizeof(pieces[i].counts));
+    }
+
+    // the calling thread counts the first piece itself
+    for (int i = 1; i < threads; i++)
+    {
+        started[i] = pthread_create(&tids[i], NULL, histogram_worker,
+            &pieces[i]) == 0;
+    }
+    histogram_worker(&pieces[0]);
+    for (int i = 1; i < threads; i++)
+    {
+        if (started[i])
+        {
+            pthread_join(tids[i], NULL);
+        }
+        else
+        {
+            histogram_worker(&pieces[i]);
+        }
+    }
+
+    // merge the private histograms
+    for (int i = 0; i < threads; i++)
+    {
+        for (int c = 0; c < 26; c++)
+        {
+            counts[c] += pieces[i].counts[c];
+        }
+    }
+}
+
+double chi_squared(const uint64_t counts[26], int shift)
+{
+    uint64_t total = 0;
+    for (int c = 0; c < 26; c++)
+    {
+        total += counts[c];
+    }
+    if (total == 0)
+    {
+        return 0.0;
+    }
+
+    // cypher letter c came from plain letter c - shift
+    double score = 0.0;
+    for (int c = 0; c < 26; c++)
+    {
+        double expected = total * english_frequencies[(c - shift + 26) % 26];
+        double diff = counts[c] - expected;
+        score += diff * diff / expected;
+    }
+    return score;
+}
+
+int best_caesar_key(const uint64_t counts[26], double *score)
+{
+    int best = 0;
+    double best_score = chi_squared(counts, 0);
+
+    for (int shift = 1; shift < 26; shift++)
+    {
+        double s = chi_squared(counts, shift);
+        if (s < best_score)
+        {
+            best = shift;
+            best_score = s;
+        }
+    }
+
+    if (score != NULL)
+    {
+        *score = best_score;
+    }
+    return best;
+}
+
+size_t letter_values(const char *in, size_t len, unsigned char *out)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char value = ((unsigned char) in[i] | 0x20) - 'a';
+        out[n] = value;
+        n += value < 26;
+    }
+    return n;
+}
+
+double index_of_coincidence(const uint64_t counts[26])
+{
+    uint64_t total = 0;
+    double pairs = 0.0;
+    for (int c = 0; c < 26; c++)
+    {
+        total += counts[c];
+        pairs += (double) counts[c] * (counts[c] - (counts[c] > 0));
+    }
+    return total > 1 ? pairs / ((double) total * (total - 1)) : 0.0;
+}
+
+// work shared by the threads of crack_vigenere
+typedef struct
+{
+    const unsigned char *letters;
+    size_t n;
+    int max_period;
+    uint64_t **columns;        // columns[p - 1] holds p histograms
+    double *scores;            // scores[p - 1] is period p's mean ioc
+    atomic_int next_period;    // next period no thread has taken
+}
+period_work;
+
+/**
+ * Takes periods until none are left, building every column's histogram
+ * for a period in one pass over the letters and scoring it.
+ */
+static void *period_worker(void *arg)
+{
+    period_work *w = arg;
+
+    int p;
+    while ((p = atomic_fetch_add(&w->next_period, 1)) <= w->max_period)
+    {
+        uint64_t *hist = w->columns[p - 1];
+
+        // hist[col * 26 + letter], col advancing with every letter
+        size_t col = 0;
+        for (size_t i = 0; i < w->n; i++)
+        {
+            hist[col + w->letters[i]]++;
+            col += 26;
+            if (col == (size_t) p * 26)
+            {
+                col = 0;
+            }
+        }
+
+        double total = 0.0;
+        for (int c = 0; c < p; c++)
+        {
+            total += index_of_coincidence(hist + c * 26);
+        }
+        w->scores[p - 1] = total / p;
+    }
+    return NULL;
+}
+
+int crack_vigenere(const unsigned char *letters, size_t n, int max_period,
+    int threads, char *key)
+{
+    if (n == 0 || max_period < 1)
+    {
+        return 0;
+    }
+    if ((size_t) max_period > n)
+    {
+        max_period = n;
+    }
+    if (threads > max_period)
+    {
+        threads = max_period;
+    }
+    if (threads < 1)
+    {
+        threads = 1;
+    }
+
+    // one block of histograms, max_period * (max_period + 1) / 2 columns
+    size_t total_columns = (size_t) max_period * (max_period + 1) / 2;
+    uint64_t *block = calloc(total_columns * 26, sizeof(uint64_t));
+    uint64_t **columns = malloc(max_period * sizeof(uint64_t *));
+    double *scores = malloc(max_period * sizeof(double));
+    pthread_t *tids = malloc(threads * sizeof(pthread_t));
+    if (block == NULL || columns == NULL || scores == NULL || tids == NULL)
+    {
+        free(block);
+        free(columns);
+        free(scores);
+        free(tids);
+        return 0;
+    }
+
+    for (int p = 1, offset = 0; p <= max_period; offset += p, p++)
+    {
+        columns[p - 1] = block + (size_t) offset * 26;
+    }
+
+    period_work work = {letters, n, max_period, columns, scores, 1};
+
+    // the calling thread works too
+    int started = 0;
+    while (started < threads - 1
+        && pthread_create(&tids[started], NULL, period_worker, &work) == 0)
+    {
+        started++;
+    }
+    period_worker(&work);
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(tids[i], NULL);
+    }
+
+    // multiples of the key length score as well as it does, so take the
+    // shortest period close to the best
+    double best = 0.0;
+    for (int p = 1; p <= max_period; p++)
+    {
+        if (scores[p - 1] > best)
+        {
+            best = scores[p - 1];
+        }
+    }
+    int period = 1;
+    while (scores[period - 1] < 0.9 * best)
+    {
+        period++;
+    }
+
+    // every column is a caesar cypher
+    for (int c = 0; c < period; c++)
+    {
+        key[c] = 'a' + best_caesar_key(columns[period - 1] + c * 26, NULL);
+    }
+    key[period] = '\0';
+
+    free(block);
+    free(columns);
+    free(scores);
+    free(tids);
+    return period;
+}
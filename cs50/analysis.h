@@ -0,0 +1,105 @@
+/**
+ * analysis.h
+ *
+ * Letter frequency analysis for recovering unknown cypher keys.
+ */
+
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// relative frequency of each letter in english text, a to z
+extern const double english_frequencies[26];
+
+/**
+ * Adds the number of times each letter, either case, occurs in the len
+ * bytes at in to counts.
+ *
+ * @param const char* in The text to count
+ * @param size_t len The number of bytes
+ * @param uint64_t* counts 26 running totals, a to z
+ *
+ * @return void
+ */
+void letter_histogram(const char *in, size_t len, uint64_t counts[26]);
+
+/**
+ * Same as letter_histogram, with the text split across threads that each
+ * build a private histogram, merged at the end.
+ *
+ * @param const char* in The text to count
+ * @param size_t len The number of bytes
+ * @param uint64_t* counts 26 running totals, a to z
+ * @param int threads The number of threads to use
+ *
+ * @return void
+ */
+void letter_histogram_parallel(const char *in, size_t len,
+    uint64_t counts[26], int threads);
+
+/**
+ * Scores how far the letter counts of text encrypted with caesar key
+ * shift are from english, by chi-squared. Lower is more english.
+ *
+ * @param const uint64_t* counts Letter counts of the encrypted text
+ * @param int shift The key to test, 0..25
+ *
+ * @return double The chi-squared statistic
+ */
+double chi_squared(const uint64_t counts[26], int shift);
+
+/**
+ * Finds the caesar key that makes counts look most like english.
+ *
+ * @param const uint64_t* counts Letter counts of the encrypted text
+ * @param double* score If not NULL, set to the best key's chi-squared
+ *
+ * @return int The most likely key, 0..25
+ */
+int best_caesar_key(const uint64_t counts[26], double *score);
+
+/**
+ * Copies the letters in the len bytes at in to out as values 0..25,
+ * dropping everything else.
+ *
+ * @param const char* in The text
+ * @param size_t len The number of bytes
+ * @param unsigned char* out Room for up to len values
+ *
+ * @return size_t The number of letters copied
+ */
+size_t letter_values(const char *in, size_t len, unsigned char *out);
+
+/**
+ * Computes the chance that two letters drawn from a text with the given
+ * letter counts are the same. About 0.066 for english, 0.038 for random
+ * letters.
+ *
+ * @param const uint64_t* counts The letter counts
+ *
+ * @return double The index of coincidence
+ */
+double index_of_coincidence(const uint64_t counts[26]);
+
+/**
+ * Recovers the key of vigenere encrypted text. Every key length from 1
+ * to max_period is scored by the mean index of coincidence of its
+ * columns; the shortest length scoring close to the best is taken, and
+ * each column's key letter is then the caesar key that makes it look
+ * most like english. Key lengths are shared out between threads, each
+ * building all columns' histograms for its length in one strided pass.
+ *
+ * @param const unsigned char* letters The text as values from letter_values
+ * @param size_t n The number of letters
+ * @param int max_period The longest key length to try
+ * @param int threads The number of threads to use
+ * @param char* key Room for max_period + 1 chars, set to the lowercase key
+ *
+ * @return int The key length, 0 if there were no letters or no memory
+ */
+int crack_vigenere(const unsigned char *letters, size_t n, int max_period,
+    int threads, char *key);
+
+#endif
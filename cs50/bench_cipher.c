@@ -0,0 +1,462 @@
+/**
+ * bench_cipher.c
+ *
+ * Throughput benchmark for the caesar and vigenere kernels. Generates
+ * deterministic corpora (lowercase, mixed case, punctuation heavy and
+ * binary) from 1 KB up to --max-size, runs every encrypt path over each
+ * and prints one CSV row per run: MB/s, cycles per byte and peak
+ * resident set. Every run is a child process of its own, holding only
+ * that run's input and output, so its peak resident set is the path's
+ * own. Every path's output is compared, by a 64 bit fingerprint, with
+ * the first path of the same cypher, and any mismatch fails the run.
+ *
+ * The original alphabet-scanning loops are kept here as the reference
+ * paths; being ~50 ns/byte they only run up to --reference-max.
+ *
+ * Usage: ./bench_cipher [--max-size BYTES] [--reference-max BYTES]
+ *                       [--threads N]
+ */
+
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cipher.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+// corpus sizes, from 1 KB growing by 16x to 1 GB
+#define MIN_SIZE ((size_t) 1 << 10)
+#define MAX_SIZE ((size_t) 1 << 30)
+#define SIZE_STEP 16
+
+// default largest corpus the reference loops run on
+#define REFERENCE_MAX ((size_t) 16 << 20)
+
+// bytes processed per measurement, small corpora are run repeatedly
+#define MIN_WORK ((size_t) 64 << 20)
+
+// caesar key and vigenere key used throughout
+#define CAESAR_KEY 13
+#define VIGENERE_KEY "bacon"
+
+// a fixed key, compiled into a table by the preprocessor
+static const unsigned char rot13[256] = CAESAR_TABLE(CAESAR_KEY);
+
+// corpora
+typedef enum
+{
+    LOWERCASE,
+    MIXED_CASE,
+    PUNCTUATION,
+    BINARY,
+    CORPORA
+}
+corpus;
+
+const char *corpus_names[CORPORA] = {"lowercase", "mixed", "punctuation", "binary"};
+
+// an encrypt path
+typedef struct
+{
+    const char *cipher;
+    const char *name;
+    void (*run)(const char *in, char *out, size_t len);
+    bool reference;
+}
+path;
+
+// what a child reports about its run
+typedef struct
+{
+    bool ok;
+    double seconds;
+    uint64_t cycles;
+    uint64_t fingerprint;       // of the output
+    long peak_rss_kb;           // filled in by the parent
+}
+result;
+
+// shared by the paths
+vigenere_key schedule;
+int threads;
+
+/**
+ * The original caesar encrypt_text loop, writing to out instead of
+ * printing.
+ */
+void reference_caesar(const char *message, char *out, size_t len, int key)
+{
+    char alphabet[] = {'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i',
+    'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v',
+    'w', 'x', 'y', 'z'};
+
+    for (size_t i = 0; i < len; i++)
+    {
+        out[i] = message[i];
+        if (isalpha((unsigned char) message[i]))
+        {
+            for (int j = 0; j < 26; j++)
+            {
+                if (tolower((unsigned char) message[i]) == alphabet[j])
+                {
+                    out[i] = islower((unsigned char) message[i])
+                        ? alphabet[(j + key) % 26]
+                        : toupper(alphabet[(j + key) % 26]);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * The original vigenere encrypt_text loop, writing to out instead of
+ * printing.
+ */
+void reference_vigenere(const char *message, char *out, size_t len,
+    const char *key)
+{
+    char alphabet[] = {'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i',
+    'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v',
+    'w', 'x', 'y', 'z'};
+
+    int key_length = strlen(key);
+    int message_val = 0;
+    int key_val = 0;
+    int char_count = 0;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        out[i] = message[i];
+        if (isalpha((unsigned char) message[i]))
+        {
+            for (int j = 0; j < 26; j++)
+            {
+                if (tolower((unsigned char) message[i]) == alphabet[j])
+                {
+                    message_val = j;
+                }
+                if (tolower((unsigned char) key[char_count % key_length]) == alphabet[j])
+                {
+                    key_val = j;
+                }
+            }
+            char c = alphabet[(message_val + key_val) % 26];
+            out[i] = islower((unsigned char) message[i]) ? c : toupper(c);
+            char_count++;
+        }
+    }
+}
+
+void caesar_reference_path(const char *in, char *out, size_t len)
+{
+    reference_caesar(in, out, len, CAESAR_KEY);
+}
+
+void caesar_table_path(const char *in, char *out, size_t len)
+{
+    translate(in, out, len, caesar_tables[CAESAR_KEY]);
+}
+
+void caesar_fixed_path(const char *in, char *out, size_t len)
+{
+    translate(in, out, len, rot13);
+}
+
+void caesar_simd_path(const char *in, char *out, size_t len)
+{
+    caesar_rotate(in, out, len, CAESAR_KEY);
+}
+
+void vigenere_reference_path(const char *in, char *out, size_t len)
+{
+    reference_vigenere(in, out, len, VIGENERE_KEY);
+}
+
+void vigenere_table_path(const char *in, char *out, size_t len)
+{
+    size_t phase = 0;
+    vigenere_rotate(in, out, len, &schedule, &phase);
+}
+
+void vigenere_threaded_path(const char *in, char *out, size_t len)
+{
+    size_t phase = 0;
+    vigenere_rotate_parallel(in, out, len, &schedule, &phase, threads);
+}
+
+// every path, grouped by cypher, each group led by its reference
+path paths[] = {
+    {"caesar", "reference", caesar_reference_path, true},
+    {"caesar", "table", caesar_table_path, false},
+    {"caesar", "fixed_table", caesar_fixed_path, false},
+    {"caesar", "simd", caesar_simd_path, false},
+    {"vigenere", "reference", vigenere_reference_path, true},
+    {"vigenere", "table", vigenere_table_path, false},
+    {"vigenere", "threaded", vigenere_threaded_path, false},
+};
+
+#define PATHS (sizeof(paths) / sizeof(paths[0]))
+
+/**
+ * Returns the current time in seconds.
+ */
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Returns the cpu's timestamp counter, or 0 where there is none.
+ */
+uint64_t cycles(void)
+{
+#ifdef HAVE_RDTSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Returns an FNV-1a style hash of len bytes, folded in 8 at a time.
+ */
+uint64_t fingerprint(const char *bytes, size_t len)
+{
+    uint64_t hash = 14695981039346656037ull;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    for (; i < len; i++)
+    {
+        hash = (hash ^ (unsigned char) bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * Runs a path reps times over len bytes of text in a child process, so
+ * that the peak resident set reported is that run's alone. Returns false
+ * if the child could not run it.
+ */
+bool run_path(const path *p, const char *text, size_t len, size_t reps,
+    result *r)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        return false;
+    }
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fds[0]);
+        result run = {.ok = false};
+        char *out = malloc(len);
+        if (out != NULL)
+        {
+            // fault the output in first so the path is not penalised
+            memset(out, 0, len);
+            double start = now();
+            uint64_t start_cycles = cycles();
+            for (size_t i = 0; i < reps; i++)
+            {
+                p->run(text, out, len);
+            }
+            run.cycles = cycles() - start_cycles;
+            run.seconds = now() - start;
+            run.fingerprint = fingerprint(out, len);
+            run.ok = true;
+        }
+        bool sent = write(fds[1], &run, sizeof(run)) == sizeof(run);
+        _exit(sent ? 0 : 1);
+    }
+    close(fds[1]);
+    if (pid < 0)
+    {
+        close(fds[0]);
+        return false;
+    }
+
+    ssize_t n;
+    do
+    {
+        n = read(fds[0], r, sizeof(*r));
+    }
+    while (n < 0 && errno == EINTR);
+    close(fds[0]);
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid)
+    {
+        return false;
+    }
+    r->peak_rss_kb = usage.ru_maxrss;
+    return n == sizeof(*r) && r->ok && WIFEXITED(status)
+        && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Fills len bytes with a deterministic corpus of the given kind.
+ */
+void generate(corpus kind, char *text, size_t len)
+{
+    const char punctuation[] = ".,;:!?'\"()-[] \n0123456789";
+    uint64_t state = 0x9E3779B97F4A7C15ull * (kind + 1);
+
+    for (size_t i = 0; i < len; i++)
+    {
+        // xorshift64
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        unsigned int r = state >> 32;
+
+        switch (kind)
+        {
+            case LOWERCASE:
+                text[i] = r % 7 == 0 ? ' ' : 'a' + r % 26;
+                break;
+            case MIXED_CASE:
+                text[i] = r % 7 == 0 ? ' ' : (r & 64 ? 'A' : 'a') + r % 26;
+                break;
+            case PUNCTUATION:
+                text[i] = r % 3 == 0 ? (char) ('a' + r % 26)
+                    : punctuation[r % (sizeof(punctuation) - 1)];
+                break;
+            default:
+                text[i] = r;
+                break;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t max_size = MAX_SIZE;
+    size_t reference_max = REFERENCE_MAX;
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    // parse command-line args
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--max-size") == 0)
+        {
+            max_size = strtoull(argv[++i], NULL, 10);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--reference-max") == 0)
+        {
+            reference_max = strtoull(argv[++i], NULL, 10);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--threads") == 0)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else
+        {
+            printf("Usage: ./bench_cipher [--max-size BYTES] "
+                "[--reference-max BYTES] [--threads N]\n");
+            return 1;
+        }
+    }
+
+    if (!vigenere_key_init(&schedule, VIGENERE_KEY, false))
+    {
+        printf("Error! Out of memory.\n");
+        return 1;
+    }
+
+    int mismatches = 0;
+    printf("cipher,path,corpus,bytes,mb_per_s,cycles_per_byte,peak_rss_kb,identical\n");
+
+    for (int kind = 0; kind < CORPORA; kind++)
+    {
+        for (size_t len = MIN_SIZE; len <= max_size; len *= SIZE_STEP)
+        {
+            // just this row's corpus, the children inherit it
+            char *text = malloc(len);
+            if (text == NULL)
+            {
+                printf("Error! Out of memory.\n");
+                return 1;
+            }
+            generate(kind, text, len);
+            const char *cipher = NULL;
+            bool have_expected = false;
+            uint64_t expected = 0;
+
+            for (size_t p = 0; p < PATHS; p++)
+            {
+                if (paths[p].reference && len > reference_max)
+                {
+                    continue;
+                }
+
+                // the first path run for each cypher sets the expected output
+                if (cipher == NULL || strcmp(cipher, paths[p].cipher) != 0)
+                {
+                    cipher = paths[p].cipher;
+                    have_expected = false;
+                }
+
+                size_t reps = len >= MIN_WORK || paths[p].reference
+                    ? 1 : MIN_WORK / len;
+                result r;
+                if (!run_path(&paths[p], text, len, reps, &r))
+                {
+                    printf("Error! Could not run %s %s on %zu bytes.\n",
+                        paths[p].cipher, paths[p].name, len);
+                    free(text);
+                    return 1;
+                }
+                double bytes = (double) len * reps;
+
+                bool identical = !have_expected || r.fingerprint == expected;
+                mismatches += !identical;
+                if (!have_expected)
+                {
+                    expected = r.fingerprint;
+                    have_expected = true;
+                }
+
+                printf("%s,%s,%s,%zu,%.1f,%.3f,%ld,%s\n", paths[p].cipher,
+                    paths[p].name, corpus_names[kind], len,
+                    bytes / r.seconds / 1e6, r.cycles / bytes, r.peak_rss_kb,
+                    identical ? "yes" : "NO");
+                fflush(stdout);
+            }
+            free(text);
+        }
+    }
+
+    vigenere_key_free(&schedule);
+
+    if (mismatches > 0)
+    {
+        fprintf(stderr, "%d paths produced different output\n", mismatches);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,177 @@
+/**
+ * bench_fifteen.c
+ *
+ * Benchmark for fifteen's solver. Generates a fixed set of random,
+ * solvable boards from --seed, solves each with the serial search and
+ * then the parallel one on --threads threads, and prints one CSV row per
+ * board with both searches' nodes and seconds and the speedup, then the
+ * speedup over the whole set on stderr. Both searches are optimal, so
+ * any difference in solution length fails the run.
+ *
+ * Usage: ./bench_fifteen [--d D] [--count N] [--seed S] [--threads N]
+ *                        [--pdb FILE]
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pdb.h"
+#include "solver.h"
+
+// default board size, number of boards and seed
+#define D 4
+#define COUNT 10
+#define SEED 15
+
+/**
+ * Returns the next number of a xorshift64* sequence.
+ */
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ull;
+}
+
+/**
+ * Fills p with a uniformly random solvable d x d board: a random
+ * arrangement, with two tiles swapped if it cannot be solved.
+ */
+static void random_board(puzzle *p, int d, uint64_t *state)
+{
+    memset(p, 0, sizeof(*p));
+    p->d = d;
+    int n = d * d;
+    for (int i = 0; i < n; i++)
+    {
+        p->cells[i] = i;
+    }
+    for (int i = n - 1; i > 0; i--)
+    {
+        int j = next_random(state) % (i + 1);
+        uint8_t tmp = p->cells[i];
+        p->cells[i] = p->cells[j];
+        p->cells[j] = tmp;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        if (p->cells[i] == 0)
+        {
+            p->blank = i;
+        }
+    }
+    if (!puzzle_solvable(p))
+    {
+        int a = p->blank == 0 ? 1 : 0;
+        int b = p->blank <= 1 ? 2 : 1;
+        uint8_t tmp = p->cells[a];
+        p->cells[a] = p->cells[b];
+        p->cells[b] = tmp;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int d = D;
+    int count = COUNT;
+    uint64_t seed = SEED;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *databases = NULL;
+
+    // parse command-line args
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--d") == 0)
+        {
+            d = atoi(argv[++i]);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--count") == 0)
+        {
+            count = atoi(argv[++i]);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--seed") == 0)
+        {
+            seed = strtoull(argv[++i], NULL, 10);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--threads") == 0)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--pdb") == 0)
+        {
+            databases = argv[++i];
+        }
+        else
+        {
+            printf("Usage: ./bench_fifteen [--d D] [--count N] [--seed S] "
+                "[--threads N] [--pdb FILE]\n");
+            return 1;
+        }
+    }
+    if (d < 3 || d > PUZZLE_MAX || count < 1 || threads < 1 || seed == 0)
+    {
+        printf("Error! --d must be 3 to %i, --count, --threads and --seed "
+            "positive.\n", PUZZLE_MAX);
+        return 1;
+    }
+
+    pdb db;
+    if (databases != NULL && !pdb_open(&db, databases))
+    {
+        printf("Error! %s\n", strerror(errno));
+        return 1;
+    }
+    if (databases != NULL && db.d != d)
+    {
+        printf("Error! Pattern databases are for %i x %i boards.\n",
+            db.d, db.d);
+        pdb_free(&db);
+        return 1;
+    }
+
+    printf("board,moves,serial_nodes,serial_s,parallel_nodes,parallel_s,"
+        "speedup\n");
+    uint64_t state = seed;
+    double serial_total = 0, parallel_total = 0;
+    bool correct = true;
+    for (int i = 0; i < count; i++)
+    {
+        puzzle p;
+        random_board(&p, d, &state);
+
+        uint8_t moves[SOLVE_MAX_MOVES];
+        solve_stats serial, parallel;
+        int length = solve(&p, databases != NULL ? &db : NULL, moves, &serial);
+        int parallel_length = solve_parallel(&p, databases != NULL ? &db : NULL,
+            threads, moves, &parallel);
+        if (length != parallel_length)
+        {
+            fprintf(stderr, "board %i: serial found %i moves, parallel %i\n",
+                i, length, parallel_length);
+            correct = false;
+        }
+
+        printf("%i,%i,%llu,%.4f,%llu,%.4f,%.2f\n", i, length, serial.nodes,
+            serial.seconds, parallel.nodes, parallel.seconds,
+            parallel.seconds > 0 ? serial.seconds / parallel.seconds : 0);
+        fflush(stdout);
+        serial_total += serial.seconds;
+        parallel_total += parallel.seconds;
+    }
+    fprintf(stderr, "%i boards: serial %.2f s, parallel %.2f s on %i "
+        "threads, speedup %.2fx\n", count, serial_total, parallel_total,
+        threads, parallel_total > 0 ? serial_total / parallel_total : 0);
+
+    if (databases != NULL)
+    {
+        pdb_free(&db);
+    }
+    return correct ? 0 : 1;
+}
@@ -0,0 +1,488 @@
+/**
+ * bench_find.c
+ *
+ * Benchmark for find's sorts and searches. Generates deterministic
+ * arrays (uniform, sorted, reverse sorted, few unique, Zipfian and
+ * sawtooth) from 1K elements up to --max-size, growing tenfold, then
+ * times every sort backend on each and every search strategy against
+ * the sorted result, for needles that are all hits and needles that are
+ * all misses. Prints one CSV row per run: ns per element for sorts, ns
+ * per query for searches. Every sort is checked against qsort and every
+ * search against the known answer, and any mismatch fails the run.
+ *
+ * Insertion sort is quadratic, so it only runs up to --insertion-max.
+ *
+ * Usage: ./bench_find [--max-size N] [--insertion-max N] [--queries N]
+ *                     [--threads N]
+ */
+
+#define _GNU_SOURCE
+
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "eytzinger.h"
+#include "helpers.h"
+#include "scan.h"
+#include "sortindex.h"
+
+// array sizes, from 1K growing by 10x to 100M
+#define MIN_SIZE 1000
+#define MAX_SIZE 100000000
+#define SIZE_STEP 10
+
+// default largest array insertion sort runs on
+#define INSERTION_MAX 20000
+
+// default needles per search measurement
+#define QUERIES (1 << 20)
+
+// elements sorted, or compared by a linear scan, per measurement at
+// least; small arrays are run repeatedly
+#define MIN_WORK ((size_t) 1 << 24)
+#define SCAN_WORK ((size_t) 1 << 30)
+
+// distinct values in the few unique distribution
+#define FEW_UNIQUE 16
+
+// length of one tooth of the sawtooth distribution
+#define TOOTH 4096
+
+// distributions
+typedef enum
+{
+    UNIFORM,
+    SORTED,
+    REVERSE,
+    FEW,
+    ZIPF,
+    SAWTOOTH,
+    DISTRIBUTIONS
+}
+distribution;
+
+const char *distribution_names[DISTRIBUTIONS] = {"uniform", "sorted",
+    "reverse", "few_unique", "zipf", "sawtooth"};
+
+// a sort backend
+typedef struct
+{
+    const char *name;
+    void (*run)(int values[], int n);
+    bool quadratic;
+}
+sorter;
+
+// a search strategy, answering count needles at once into hits
+typedef struct
+{
+    const char *name;
+    void (*run)(const int needles[], size_t count, unsigned char *hits);
+    bool linear;
+}
+searcher;
+
+// shared by the backends and strategies
+int threads;
+int *sorted;
+int *unsorted;
+size_t size;
+int *tree;
+sortindex fenced;
+
+/**
+ * Orders ints for qsort.
+ */
+int compare_ints(const void *a, const void *b)
+{
+    int x = *(const int *) a;
+    int y = *(const int *) b;
+    return (x > y) - (x < y);
+}
+
+void qsort_backend(int values[], int n)
+{
+    qsort(values, n, sizeof(int), compare_ints);
+}
+
+void radix_backend(int values[], int n)
+{
+    sort_radix(values, n, 1);
+}
+
+void radix_parallel_backend(int values[], int n)
+{
+    sort_radix(values, n, threads);
+}
+
+// every sort backend, led by the reference
+sorter sorters[] = {
+    {"qsort", qsort_backend, false},
+    {"sort", sort, false},
+    {"insertion", sort_insertion, true},
+    {"radix", radix_backend, false},
+    {"radix_parallel", radix_parallel_backend, false},
+};
+
+#define SORTERS (sizeof(sorters) / sizeof(sorters[0]))
+
+/**
+ * Sets bit i of hits if found.
+ */
+static inline void record(unsigned char *hits, size_t i, bool found)
+{
+    hits[i / 8] |= found << (i % 8);
+}
+
+/**
+ * Binary search without branches on the comparison: the range halves
+ * every step whatever the outcome, so there is nothing to mispredict.
+ */
+bool branchless_search(const int values[], size_t n, int value)
+{
+    if (n == 0)
+    {
+        return false;
+    }
+    const int *base = values;
+    while (n > 1)
+    {
+        size_t half = n / 2;
+        base = base[half] <= value ? base + half : base;
+        n -= half;
+    }
+    return *base == value;
+}
+
+void binary_strategy(const int needles[], size_t count, unsigned char *hits)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        record(hits, i, search(needles[i], sorted, size));
+    }
+}
+
+void branchless_strategy(const int needles[], size_t count,
+    unsigned char *hits)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        record(hits, i, branchless_search(sorted, size, needles[i]));
+    }
+}
+
+void fenced_strategy(const int needles[], size_t count, unsigned char *hits)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        record(hits, i, sortindex_search(&fenced, needles[i]));
+    }
+}
+
+void eytzinger_strategy(const int needles[], size_t count,
+    unsigned char *hits)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        record(hits, i, eytzinger_search(tree, size, needles[i]));
+    }
+}
+
+void eytzinger_batch_strategy(const int needles[], size_t count,
+    unsigned char *hits)
+{
+    eytzinger_search_batch(tree, size, needles, count, hits);
+}
+
+void linear_simd_strategy(const int needles[], size_t count,
+    unsigned char *hits)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        record(hits, i, scan_contains(unsorted, size, needles[i]));
+    }
+}
+
+// every search strategy
+searcher searchers[] = {
+    {"binary", binary_strategy, false},
+    {"branchless", branchless_strategy, false},
+    {"fenced", fenced_strategy, false},
+    {"eytzinger", eytzinger_strategy, false},
+    {"eytzinger_batch", eytzinger_batch_strategy, false},
+    {"linear_simd", linear_simd_strategy, true},
+};
+
+#define SEARCHERS (sizeof(searchers) / sizeof(searchers[0]))
+
+/**
+ * Returns the current time in seconds.
+ */
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Returns the next number of a deterministic sequence (xorshift64).
+ */
+uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/**
+ * Scrambles a rank into a value, so that ranks near each other are not
+ * near each other once sorted.
+ */
+int scramble(uint64_t rank)
+{
+    uint64_t h = rank * 0x9E3779B97F4A7C15ull;
+    return (int) (h >> 32);
+}
+
+/**
+ * Fills n values with a deterministic array of the given distribution.
+ */
+void generate(distribution kind, int values[], size_t n)
+{
+    uint64_t state = 0x9E3779B97F4A7C15ull * (kind + 1);
+    double log_n = log((double) n);
+    int64_t step = UINT32_MAX / n;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        uint64_t r = next_random(&state);
+        switch (kind)
+        {
+            case UNIFORM:
+                values[i] = (int) (r >> 32);
+                break;
+            case SORTED:
+                values[i] = INT_MIN + (int64_t) i * step;
+                break;
+            case REVERSE:
+                values[i] = INT_MIN + (int64_t) (n - 1 - i) * step;
+                break;
+            case FEW:
+                values[i] = scramble(r % FEW_UNIQUE);
+                break;
+            case ZIPF:
+                // rank about n^u for uniform u, so P(rank) ~ 1 / rank
+                values[i] = scramble((uint64_t) exp(log_n
+                    * ((r >> 11) * (1.0 / (1ull << 53)))));
+                break;
+            default:
+                values[i] = (int) ((i % TOOTH) * 1000 + i / TOOTH % 7);
+                break;
+        }
+    }
+}
+
+/**
+ * Fills count needles that are all in the array, or with miss all not
+ * in it, judged by the sorted copy.
+ */
+void make_needles(int needles[], size_t count, bool miss, uint64_t seed)
+{
+    uint64_t state = seed;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!miss)
+        {
+            needles[i] = unsorted[next_random(&state) % size];
+            continue;
+        }
+        do
+        {
+            needles[i] = (int) (next_random(&state) >> 32);
+        }
+        while (branchless_search(sorted, size, needles[i]));
+    }
+}
+
+/**
+ * Builds the fences a sortindex of the sorted array would carry, so its
+ * search can run straight off memory.
+ */
+bool build_fences(void)
+{
+    size_t count = (size + SORTINDEX_STRIDE - 1) / SORTINDEX_STRIDE;
+    int *fences = malloc((count + 1) * sizeof(int));
+    if (fences == NULL)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        fences[i] = sorted[i * SORTINDEX_STRIDE];
+    }
+    fenced = (sortindex) {sorted, size, fences, count, SORTINDEX_STRIDE, 0,
+        NULL, 0};
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t max_size = MAX_SIZE;
+    size_t insertion_max = INSERTION_MAX;
+    size_t queries = QUERIES;
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    // parse command-line args
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--max-size") == 0)
+        {
+            max_size = strtoull(argv[++i], NULL, 10);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--insertion-max") == 0)
+        {
+            insertion_max = strtoull(argv[++i], NULL, 10);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--queries") == 0)
+        {
+            queries = strtoull(argv[++i], NULL, 10);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--threads") == 0)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else
+        {
+            printf("Usage: ./bench_find [--max-size N] [--insertion-max N] "
+                "[--queries N] [--threads N]\n");
+            return 1;
+        }
+    }
+    if (max_size > INT_MAX || queries == 0)
+    {
+        printf("Error! --max-size must fit an int, --queries be positive.\n");
+        return 1;
+    }
+
+    unsorted = malloc(max_size * sizeof(int));
+    sorted = malloc(max_size * sizeof(int));
+    int *work = malloc(max_size * sizeof(int));
+    int *needles = malloc(queries * sizeof(int));
+    unsigned char *hits = malloc(queries / 8 + 1);
+    if (unsorted == NULL || sorted == NULL || work == NULL || needles == NULL
+        || hits == NULL)
+    {
+        printf("Error! Out of memory.\n");
+        return 1;
+    }
+
+    int failures = 0;
+    printf("op,backend,distribution,elements,workload,ns_per_element,"
+        "ns_per_query,correct\n");
+
+    for (int kind = 0; kind < DISTRIBUTIONS; kind++)
+    {
+        for (size = MIN_SIZE; size <= max_size; size *= SIZE_STEP)
+        {
+            generate(kind, unsorted, size);
+
+            // qsort runs first and sets the expected result
+            for (size_t s = 0; s < SORTERS; s++)
+            {
+                if (sorters[s].quadratic && size > insertion_max)
+                {
+                    continue;
+                }
+                int *dest = s == 0 ? sorted : work;
+
+                size_t reps = size >= MIN_WORK ? 1 : MIN_WORK / size;
+                if (sorters[s].quadratic)
+                {
+                    reps = 1;
+                }
+                double seconds = 0;
+                for (size_t r = 0; r < reps; r++)
+                {
+                    memcpy(dest, unsorted, size * sizeof(int));
+                    double start = now();
+                    sorters[s].run(dest, size);
+                    seconds += now() - start;
+                }
+
+                bool correct = s == 0
+                    || memcmp(work, sorted, size * sizeof(int)) == 0;
+                failures += !correct;
+
+                printf("sort,%s,%s,%zu,,%.2f,,%s\n", sorters[s].name,
+                    distribution_names[kind], size,
+                    seconds * 1e9 / ((double) size * reps),
+                    correct ? "yes" : "NO");
+                fflush(stdout);
+            }
+
+            tree = eytzinger_build(sorted, size);
+            if (tree == NULL || !build_fences())
+            {
+                printf("Error! Out of memory.\n");
+                return 1;
+            }
+
+            for (int miss = 0; miss < 2; miss++)
+            {
+                make_needles(needles, queries, miss, size * 2 + miss + 1);
+                for (size_t s = 0; s < SEARCHERS; s++)
+                {
+                    // a scan per needle is only worth a few needles
+                    size_t count = queries;
+                    if (searchers[s].linear && SCAN_WORK / size < count)
+                    {
+                        count = SCAN_WORK / size > 16 ? SCAN_WORK / size : 16;
+                        count = count < queries ? count : queries;
+                    }
+
+                    memset(hits, 0, count / 8 + 1);
+                    double start = now();
+                    searchers[s].run(needles, count, hits);
+                    double seconds = now() - start;
+
+                    // hits all set, or misses all clear
+                    bool correct = true;
+                    for (size_t i = 0; i < count; i++)
+                    {
+                        correct &= (bool) (hits[i / 8] & (1 << (i % 8))) == !miss;
+                    }
+                    failures += !correct;
+
+                    printf("search,%s,%s,%zu,%s,,%.2f,%s\n", searchers[s].name,
+                        distribution_names[kind], size, miss ? "miss" : "hit",
+                        seconds * 1e9 / count, correct ? "yes" : "NO");
+                    fflush(stdout);
+                }
+            }
+
+            eytzinger_free(tree);
+            free((void *) fenced.fences);
+        }
+    }
+
+    free(unsorted);
+    free(sorted);
+    free(work);
+    free(needles);
+    free(hits);
+
+    if (failures > 0)
+    {
+        fprintf(stderr, "%d runs gave wrong answers\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,183 @@
+/**
+ * bloom.c
+ *
+ * Blocked Bloom filter. A value's hash picks one 512 bit block and then
+ * every bit it sets inside it, so a lookup reads one cache line however
+ * many bits it checks. Crowding the bits into blocks costs some accuracy
+ * over a plain Bloom filter, as blocks that draw more than their share of
+ * values fill up, so filters are sized by the blocked false positive
+ * rate rather than the plain one.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bloom.h"
+
+// size of a cache line
+#define CACHE_LINE 64
+
+// most bits set per value
+#define MAX_HASHES 16
+
+// bits it takes to pick one bit of a block
+#define BIT_INDEX_BITS 9
+
+// most bits per value a filter is given
+#define MAX_BITS 64.0
+
+/**
+ * Scrambles a value into 64 well mixed bits (splitmix64's finalizer).
+ */
+static inline uint64_t hash(int value)
+{
+    uint64_t h = (uint32_t) value;
+    h += 0x9e3779b97f4a7c15ull;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    return h ^ (h >> 31);
+}
+
+/**
+ * Returns the block a hash falls in, scaling its top bits rather than
+ * dividing.
+ */
+static inline uint64_t *block_of(const bloom *filter, uint64_t h)
+{
+    size_t i = ((h >> 32) * (uint64_t) filter->count) >> 32;
+    return filter->blocks + i * BLOOM_BLOCK_WORDS;
+}
+
+/**
+ * Returns the false positive rate of a blocked filter with bits per
+ * value and hashes bits set per value. Values per block are Poisson
+ * distributed, each block answering like a small plain filter.
+ */
+static double blocked_fp(double bits, int hashes)
+{
+    double lambda = BLOOM_BLOCK_BITS / bits;
+    double p = exp(-lambda);
+    double fp = 0;
+    for (int i = 0; i < 4 * lambda + 64; i++)
+    {
+        if (i > 0)
+        {
+            p *= lambda / i;
+        }
+        double set = 1 - pow(1 - 1.0 / BLOOM_BLOCK_BITS, (double) hashes * i);
+        fp += p * pow(set, hashes);
+    }
+    return fp;
+}
+
+/**
+ * Steps a multiplicative sequence seeded by a value's hash, returning
+ * the next bit it sets within its block from the top bits.
+ */
+static inline int next_bit(uint64_t *x)
+{
+    *x *= 0x9e3779b97f4a7c15ull;
+    return *x >> (64 - BIT_INDEX_BITS);
+}
+
+bool bloom_init(bloom *filter, size_t n, double fp_rate)
+{
+    if (!(fp_rate > 0 && fp_rate < 1))
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    // start from what a plain filter needs, adding bits until the best
+    // number of hashes brings a blocked one down to fp_rate
+    double bits = -log(fp_rate) / (M_LN2 * M_LN2);
+    int hashes = 1;
+    for (bits = bits < 1 ? 1 : bits; bits < MAX_BITS; bits += 0.25)
+    {
+        double best = 1;
+        for (int k = 1; k <= MAX_HASHES; k++)
+        {
+            double fp = blocked_fp(bits, k);
+            if (fp < best)
+            {
+                best = fp;
+                hashes = k;
+            }
+        }
+        if (best <= fp_rate)
+        {
+            break;
+        }
+    }
+
+    double total = ceil(bits * (n ? n : 1) / BLOOM_BLOCK_BITS);
+    if (total > (double) (SIZE_MAX / CACHE_LINE))
+    {
+        errno = ENOMEM;
+        return false;
+    }
+    size_t count = total;
+    if (count > UINT32_MAX)
+    {
+        // block_of scales 32 bits of hash
+        errno = ENOMEM;
+        return false;
+    }
+
+    void *blocks;
+    if (posix_memalign(&blocks, CACHE_LINE, count * CACHE_LINE) != 0)
+    {
+        errno = ENOMEM;
+        return false;
+    }
+    memset(blocks, 0, count * CACHE_LINE);
+
+    *filter = (bloom) {blocks, count, hashes, bits};
+    return true;
+}
+
+void bloom_add(bloom *filter, const int values[], size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        uint64_t h = hash(values[i]);
+        uint64_t *block = block_of(filter, h);
+
+        uint64_t x = h;
+        for (int j = 0; j < filter->hashes; j++)
+        {
+            int bit = next_bit(&x);
+            block[bit >> 6] |= 1ull << (bit & 63);
+        }
+    }
+}
+
+bool bloom_contains(const bloom *filter, int value)
+{
+    uint64_t h = hash(value);
+    const uint64_t *block = block_of(filter, h);
+
+    uint64_t x = h;
+    uint64_t missing = 0;
+    for (int j = 0; j < filter->hashes; j++)
+    {
+        int bit = next_bit(&x);
+        missing |= ~block[bit >> 6] & (1ull << (bit & 63));
+    }
+    return missing == 0;
+}
+
+size_t bloom_bytes(const bloom *filter)
+{
+    return filter->count * CACHE_LINE;
+}
+
+void bloom_free(bloom *filter)
+{
+    free(filter->blocks);
+    filter->blocks = NULL;
+}
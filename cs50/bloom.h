@@ -0,0 +1,80 @@
+/**
+ * bloom.h
+ *
+ * Blocked Bloom filter over a haystack, to turn away most needles that
+ * are not in it before they are searched for.
+ */
+
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// a block is one cache line
+#define BLOOM_BLOCK_WORDS 8
+#define BLOOM_BLOCK_BITS (BLOOM_BLOCK_WORDS * 64)
+
+typedef struct
+{
+    uint64_t *blocks;   // BLOOM_BLOCK_WORDS words per block
+    size_t count;       // number of blocks
+    int hashes;         // bits set per value
+    double bits_per_value;
+}
+bloom;
+
+/**
+ * Sizes an empty filter for n values to give about fp_rate false
+ * positives, every value's bits falling in a single cache line.
+ *
+ * @param bloom* filter The filter to set up
+ * @param size_t n The number of values it will hold
+ * @param double fp_rate Wanted chance of a false positive, in (0, 1)
+ *
+ * @return bool false with errno set on failure
+ */
+bool bloom_init(bloom *filter, size_t n, double fp_rate);
+
+/**
+ * Adds n values to a filter.
+ *
+ * @param bloom* filter The filter
+ * @param const int* values The values
+ * @param size_t n The number of values
+ *
+ * @return void
+ */
+void bloom_add(bloom *filter, const int values[], size_t n);
+
+/**
+ * Returns false if value is certainly not in the filter, true if it may
+ * be.
+ *
+ * @param const bloom* filter The filter
+ * @param int value The value to look for
+ *
+ * @return bool Whether it may be there
+ */
+bool bloom_contains(const bloom *filter, int value);
+
+/**
+ * Returns the bytes a filter takes.
+ *
+ * @param const bloom* filter The filter
+ *
+ * @return size_t Its size
+ */
+size_t bloom_bytes(const bloom *filter);
+
+/**
+ * Frees a filter.
+ *
+ * @param bloom* filter The filter
+ *
+ * @return void
+ */
+void bloom_free(bloom *filter);
+
+#endif
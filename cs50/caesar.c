@@ -1,79 +1,254 @@
-#include <ctype.h>
 #include <cs50.h>
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
-void encrypt_text(string, int);
+#include "analysis.h"
+#include "cipher.h"
+#include "outbuf.h"
+#include "stream.h"
+
+void encrypt_text(string, int, outbuf *);
+void encrypt_chunk(const char *, char *, size_t, void *);
+bool crack(string, outbuf *, bool, int);
+void count_chunk(const char *, size_t, void *);
+
+// letter counts of a streamed file, and the threads counting them
+typedef struct
+{
+    uint64_t counts[26];
+    int threads;
+}
+crack_state;
 
 int main(int argc, string argv[])
 {
+    string in_path = NULL;    // --in FILE, streams instead of prompting
+    string out_path = NULL;   // --out FILE
+    string key_arg = NULL;    // the key
+    bool unbuffered = false;  // --unbuffered, write output immediately
+    bool cracking = false;    // --crack, find the key of the input
+    bool show = false;        // --show, print the decrypted input too
+    bool decrypt = false;     // --decrypt, undo the cypher
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    
+    // parse command-line args
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--in") == 0 && i + 1 < argc)
+        {
+            in_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+        {
+            out_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--unbuffered") == 0)
+        {
+            unbuffered = true;
+        }
+        else if (strcmp(argv[i], "--crack") == 0)
+        {
+            cracking = true;
+        }
+        else if (strcmp(argv[i], "--show") == 0)
+        {
+            show = true;
+        }
+        else if (strcmp(argv[i], "--decrypt") == 0)
+        {
+            decrypt = true;
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (key_arg == NULL)
+        {
+            key_arg = argv[i];
+        }
+        else
+        {
+            printf("Error! One key required, %d given.\n", argc - 1);
+            return 1;
+        }
+    }
+    
     // check command-line arg
-    if (argc != 2)
+    if ((key_arg == NULL) != cracking)
     {
-        printf("Error! One command line argument required, %d given.\n", argc - 1);
+        printf("Usage: ./caesar [--decrypt] [--in FILE] [--out FILE] [--unbuffered] key\n");
+        printf("       ./caesar --crack [--show] [--in FILE] [--out FILE] [--threads N]\n");
         return 1;
     }
     
     // check for positive integer
-    if (argv[1] < 0)
+    int key = cracking ? 0 : atoi(key_arg);
+    if (key < 0)
     {
         printf("Error! Argument must be a positive integer.\n");
         return 1;
     }
     
+    if (threads < 1)
+    {
+        threads = 1;
+    }
+    
+    // decrypting is encrypting the rest of the way round
+    if (decrypt)
+    {
+        key = caesar_key(-key);
+    }
+    
+    // all output goes through one buffer
+    outbuf out;
+    if (!outbuf_open(&out, out_path ? out_path : "-", OUTBUF_SIZE, unbuffered))
+    {
+        printf("Error! %s\n", strerror(errno));
+        return 1;
+    }
+    
+    // recover an unknown key
+    if (cracking)
+    {
+        if (!crack(in_path ? in_path : "-", &out, show, threads)
+            || !outbuf_close(&out))
+        {
+            printf("Error! %s\n", strerror(errno));
+            return 1;
+        }
+        return 0;
+    }
+    
+    // stream a whole file, "-" meaning stdin
+    if (in_path != NULL || out_path != NULL)
+    {
+        if (!stream_file(in_path ? in_path : "-", &out, STREAM_CHUNK,
+            encrypt_chunk, &key) || !outbuf_close(&out))
+        {
+            printf("Error! %s\n", strerror(errno));
+            return 1;
+        }
+        return 0;
+    }
+    
     // get message from user
     //printf("Enter the message to be encrypted: ");
     string message = GetString();
+    if (message == NULL)
+    {
+        outbuf_close(&out);
+        return 1;
+    }
     
     // encrypt message
-    encrypt_text(message, atoi(argv[1]));
+    encrypt_text(message, key, &out);
     
-    printf("\n");
+    outbuf_append(&out, "\n", 1);
+    outbuf_close(&out);
 
     return 0;
 }
 
 /**
- * Encrypts message with Caesar cypher and prints the encrypted message to
- * the screen
+ * Encrypts message with Caesar cypher and writes the encrypted message to
+ * out
  *
  * @param string message The string to be encrypted
  * @param int key The key to rotate the characters by
+ * @param outbuf* out Where to write the encrypted message
  *
  * @return void
  */
- void encrypt_text(string message,  int key)
+ void encrypt_text(string message,  int key, outbuf *out)
  {
-    char alphabet[] = {'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i',
-    'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v',
-    'w', 'x', 'y', 'z'};
+    size_t len = strlen(message);
     
-    char encrypted_text[strlen(message)];
+    // rotate the whole message at once, in place
+    caesar_encrypt(message, len, key);
     
-    for (int i = 0, len = strlen(message); i < len; i++)
+    outbuf_append(out, message, len);
+ }
+
+/**
+ * Encrypts one chunk of a streamed file
+ *
+ * @param const char* in The chunk to be encrypted
+ * @param char* out Where to store the encrypted chunk
+ * @param size_t len The size of the chunk
+ * @param void* key Points to the int key
+ *
+ * @return void
+ */
+ void encrypt_chunk(const char *in, char *out, size_t len, void *key)
+ {
+    caesar_rotate(in, out, len, *(int *) key);
+ }
+
+/**
+ * Finds the key a file was most likely encrypted with by comparing its
+ * letter frequencies with english, reading it once. The key is written
+ * to out, or with show to stderr followed by the decrypted file to out,
+ * which needs a second pass and so a file that can be read again.
+ *
+ * @param string in_path The file to crack, "-" meaning stdin
+ * @param outbuf* out Where to write the key or decrypted text
+ * @param bool show Whether to write the decrypted text
+ * @param int threads The number of threads counting letters
+ *
+ * @return bool false with errno set on failure
+ */
+ bool crack(string in_path, outbuf *out, bool show, int threads)
+ {
+    // a pipe cannot be read twice
+    bool from_stdin = strcmp(in_path, "-") == 0;
+    if (show && from_stdin && lseek(STDIN_FILENO, 0, SEEK_CUR) < 0)
     {
-        if (isalpha(message[i]))
-        {
-            for (int j = 0; j < 26; j++)
-            {
-                    if (tolower(message[i]) == alphabet[j])
-                    {
-                        if (j + key < 26)
-                        {
-                            encrypted_text[i] = islower(message[i]) ? alphabet[j + key]: toupper(alphabet[j + key]);
-                        }
-                        else
-                        {
-                            encrypted_text[i] = islower(message[i]) ? alphabet[(j + key) % 26]: toupper(alphabet[(j + key) % 26]);
-                        }
-                    }
-            }
-        }
-        else
-        {
-            encrypted_text[i] = message[i];
-        }
-        
-        printf("%c", encrypted_text[i]);
+        return false;
+    }
+    
+    crack_state state = {{0}, threads};
+    size_t chunk = (size_t) threads * 4 * STREAM_CHUNK;
+    if (!stream_scan(in_path, chunk, count_chunk, &state))
+    {
+        return false;
+    }
+    
+    double score;
+    int key = best_caesar_key(state.counts, &score);
+    
+    if (!show)
+    {
+        char line[32];
+        int len = snprintf(line, sizeof(line), "%d\n", key);
+        return outbuf_append(out, line, len);
+    }
+    
+    fprintf(stderr, "key: %d (chi-squared %.1f)\n", key, score);
+    
+    if (from_stdin && lseek(STDIN_FILENO, 0, SEEK_SET) != 0)
+    {
+        return false;
     }
+    
+    int decrypt_key = caesar_key(-key);
+    return stream_file(in_path, out, STREAM_CHUNK, encrypt_chunk, &decrypt_key);
+ }
+
+/**
+ * Adds the letter counts of one chunk of a streamed file
+ *
+ * @param const char* in The chunk to count
+ * @param size_t len The size of the chunk
+ * @param void* state Points to the crack_state
+ *
+ * @return void
+ */
+ void count_chunk(const char *in, size_t len, void *state)
+ {
+    crack_state *s = state;
+    letter_histogram_parallel(in, len, s->counts, s->threads);
  }
@@ -0,0 +1,395 @@
+/**
+ * cipher.c
+ *
+ * Caesar and vigenere cypher library.
+ *
+ * A byte b is a letter when (b | 0x20) - 'a' < 26; setting bit 0x20 folds
+ * upper case onto lower case, so one range compare covers both. The
+ * rotated letter is rebuilt from 'A' and the original case bit. On x86
+ * the work is done 16 (SSE2) or 32 (AVX2) bytes at a time, with the
+ * widest kernel the cpu supports picked once, on first use.
+ *
+ * Everything else goes through 256 entry translation tables, one per
+ * caesar key, generated at compile time; a vigenere key is compiled to
+ * the list of tables for its letters, so encrypting a byte costs one
+ * table load whatever the cypher.
+ */
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cipher.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CIPHER_X86 1
+#endif
+
+const unsigned char caesar_tables[26][256] = {
+    CAESAR_TABLE(0), CAESAR_TABLE(1), CAESAR_TABLE(2), CAESAR_TABLE(3),
+    CAESAR_TABLE(4), CAESAR_TABLE(5), CAESAR_TABLE(6), CAESAR_TABLE(7),
+    CAESAR_TABLE(8), CAESAR_TABLE(9), CAESAR_TABLE(10), CAESAR_TABLE(11),
+    CAESAR_TABLE(12), CAESAR_TABLE(13), CAESAR_TABLE(14), CAESAR_TABLE(15),
+    CAESAR_TABLE(16), CAESAR_TABLE(17), CAESAR_TABLE(18), CAESAR_TABLE(19),
+    CAESAR_TABLE(20), CAESAR_TABLE(21), CAESAR_TABLE(22), CAESAR_TABLE(23),
+    CAESAR_TABLE(24), CAESAR_TABLE(25)
+};
+
+int caesar_key(int key)
+{
+    key %= 26;
+    return key < 0 ? key + 26 : key;
+}
+
+void translate(const char *in, char *out, size_t len,
+    const unsigned char table[256])
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        out[i] = table[(unsigned char) in[i]];
+    }
+}
+
+/**
+ * Portable kernel, also used for the tails of the vector kernels.
+ */
+static void rotate_scalar(const char *in, char *out, size_t len, int key)
+{
+    translate(in, out, len, caesar_tables[key]);
+}
+
+#ifdef CIPHER_X86
+
+/**
+ * SSE2 kernel, 16 bytes per iteration.
+ */
+__attribute__((target("sse2")))
+static void rotate_sse2(const char *in, char *out, size_t len, int key)
+{
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i lower_a = _mm_set1_epi8('a');
+    const __m128i upper_a = _mm_set1_epi8('A');
+    const __m128i last = _mm_set1_epi8(25);
+    const __m128i wrap = _mm_set1_epi8(26);
+    const __m128i shift = _mm_set1_epi8((char) key);
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i b = _mm_loadu_si128((const __m128i *) (in + i));
+
+        // offset into the alphabet, letters land in 0..25
+        __m128i offset = _mm_sub_epi8(_mm_or_si128(b, case_bit), lower_a);
+        __m128i letter = _mm_cmpeq_epi8(_mm_min_epu8(offset, last), offset);
+
+        // add the key, subtracting 26 where it ran past 'z'
+        __m128i sum = _mm_add_epi8(offset, shift);
+        __m128i inside = _mm_cmpeq_epi8(_mm_min_epu8(sum, last), sum);
+        sum = _mm_sub_epi8(sum, _mm_andnot_si128(inside, wrap));
+
+        // rebuild the letter with its original case
+        __m128i rotated = _mm_or_si128(_mm_add_epi8(sum, upper_a),
+            _mm_and_si128(b, case_bit));
+
+        __m128i result = _mm_or_si128(_mm_and_si128(letter, rotated),
+            _mm_andnot_si128(letter, b));
+        _mm_storeu_si128((__m128i *) (out + i), result);
+    }
+
+    rotate_scalar(in + i, out + i, len - i, key);
+}
+
+/**
+ * AVX2 kernel, 32 bytes per iteration.
+ */
+__attribute__((target("avx2")))
+static void rotate_avx2(const char *in, char *out, size_t len, int key)
+{
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    const __m256i lower_a = _mm256_set1_epi8('a');
+    const __m256i upper_a = _mm256_set1_epi8('A');
+    const __m256i last = _mm256_set1_epi8(25);
+    const __m256i wrap = _mm256_set1_epi8(26);
+    const __m256i shift = _mm256_set1_epi8((char) key);
+
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i b = _mm256_loadu_si256((const __m256i *) (in + i));
+
+        __m256i offset = _mm256_sub_epi8(_mm256_or_si256(b, case_bit), lower_a);
+        __m256i letter = _mm256_cmpeq_epi8(_mm256_min_epu8(offset, last), offset);
+
+        __m256i sum = _mm256_add_epi8(offset, shift);
+        __m256i inside = _mm256_cmpeq_epi8(_mm256_min_epu8(sum, last), sum);
+        sum = _mm256_sub_epi8(sum, _mm256_andnot_si256(inside, wrap));
+
+        __m256i rotated = _mm256_or_si256(_mm256_add_epi8(sum, upper_a),
+            _mm256_and_si256(b, case_bit));
+
+        _mm256_storeu_si256((__m256i *) (out + i),
+            _mm256_blendv_epi8(b, rotated, letter));
+    }
+
+    rotate_sse2(in + i, out + i, len - i, key);
+}
+
+#endif
+
+// kernel picked for this cpu, resolved once, by whichever thread calls
+// first
+typedef void (*rotate_kernel)(const char *, char *, size_t, int);
+static rotate_kernel kernel = NULL;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Picks the widest kernel the running cpu supports.
+ */
+static void pick_kernel(void)
+{
+    kernel = rotate_scalar;
+#ifdef CIPHER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        kernel = rotate_avx2;
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        kernel = rotate_sse2;
+    }
+#endif
+}
+
+void caesar_rotate(const char *in, char *out, size_t len, int key)
+{
+    pthread_once(&kernel_once, pick_kernel);
+    kernel(in, out, len, caesar_key(key));
+}
+
+void caesar_encrypt(char *text, size_t len, int key)
+{
+    caesar_rotate(text, text, len, key);
+}
+
+void caesar_decrypt(char *text, size_t len, int key)
+{
+    caesar_rotate(text, text, len, -caesar_key(key));
+}
+
+bool vigenere_key_init(vigenere_key *schedule, const char *key, bool decrypt)
+{
+    size_t length = strlen(key);
+    if (length == 0)
+    {
+        return false;
+    }
+
+    const unsigned char **tables = malloc(length * sizeof(*tables));
+    if (tables == NULL)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < length; i++)
+    {
+        if (!isalpha((unsigned char) key[i]))
+        {
+            free(tables);
+            return false;
+        }
+        int shift = tolower((unsigned char) key[i]) - 'a';
+        tables[i] = caesar_tables[decrypt ? (26 - shift) % 26 : shift];
+    }
+
+    schedule->length = length;
+    schedule->tables = tables;
+    return true;
+}
+
+void vigenere_key_free(vigenere_key *schedule)
+{
+    free(schedule->tables);
+    schedule->tables = NULL;
+    schedule->length = 0;
+}
+
+void vigenere_rotate(const char *in, char *out, size_t len,
+    const vigenere_key *key, size_t *phase)
+{
+    const unsigned char **tables = key->tables;
+    size_t key_length = key->length;
+    size_t j = *phase % key_length;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char b = (unsigned char) in[i];
+        out[i] = tables[j][b];
+
+        // only letters move on to the next key letter
+        j += (unsigned char) ((b | 0x20) - 'a') < 26;
+        if (j == key_length)
+        {
+            j = 0;
+        }
+    }
+
+    *phase = j;
+}
+
+size_t count_letters(const char *in, size_t len)
+{
+    // branch free so the compiler can vectorise it
+    size_t count = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        count += (unsigned char) (((unsigned char) in[i] | 0x20) - 'a') < 26;
+    }
+    return count;
+}
+
+// smallest piece worth handing to a thread
+#define PARALLEL_MIN_PIECE (64 * 1024)
+
+// most threads vigenere_rotate_parallel will start
+#define PARALLEL_MAX_THREADS 256
+
+// one thread's share of vigenere_rotate_parallel
+typedef struct
+{
+    const char *in;
+    char *out;
+    size_t len;
+    const vigenere_key *key;
+    size_t letters;            // letters in this piece
+    size_t phase;              // key position this piece starts at
+}
+vigenere_piece;
+
+/**
+ * First pass, counts the letters in a piece.
+ */
+static void *count_worker(void *arg)
+{
+    vigenere_piece *p = arg;
+    p->letters = count_letters(p->in, p->len);
+    return NULL;
+}
+
+/**
+ * Second pass, encrypts a piece from its starting key position.
+ */
+static void *encrypt_worker(void *arg)
+{
+    vigenere_piece *p = arg;
+    vigenere_rotate(p->in, p->out, p->len, p->key, &p->phase);
+    return NULL;
+}
+
+/**
+ * Runs worker over every piece, one thread each, with the calling thread
+ * taking the first piece. Pieces whose thread cannot be started are run
+ * by the calling thread too.
+ */
+static void run_pieces(void *(*worker)(void *), vigenere_piece *pieces,
+    int count)
+{
+    pthread_t tids[PARALLEL_MAX_THREADS];
+    bool started[PARALLEL_MAX_THREADS];
+
+    for (int i = 1; i < count; i++)
+    {
+        started[i] = pthread_create(&tids[i], NULL, worker, &pieces[i]) == 0;
+    }
+    worker(&pieces[0]);
+    for (int i = 1; i < count; i++)
+    {
+        if (started[i])
+        {
+            pthread_join(tids[i], NULL);
+        }
+        else
+        {
+            worker(&pieces[i]);
+        }
+    }
+}
+
+void vigenere_rotate_parallel(const char *in, char *out, size_t len,
+    const vigenere_key *key, size_t *phase, int threads)
+{
+    if (threads > PARALLEL_MAX_THREADS)
+    {
+        threads = PARALLEL_MAX_THREADS;
+    }
+    if ((size_t) threads > len / PARALLEL_MIN_PIECE)
+    {
+        threads = len / PARALLEL_MIN_PIECE;
+    }
+    if (threads <= 1)
+    {
+        vigenere_rotate(in, out, len, key, phase);
+        return;
+    }
+
+    vigenere_piece pieces[PARALLEL_MAX_THREADS];
+    size_t piece_len = len / threads;
+    for (int i = 0; i < threads; i++)
+    {
+        size_t offset = i * piece_len;
+        pieces[i] = (vigenere_piece) {
+            .in = in + offset,
+            .out = out + offset,
+            .len = i == threads - 1 ? len - offset : piece_len,
+            .key = key,
+        };
+    }
+
+    run_pieces(count_worker, pieces, threads);
+
+    // exclusive prefix sum gives every piece its starting key position
+    size_t key_length = key->length;
+    size_t next = *phase;
+    for (int i = 0; i < threads; i++)
+    {
+        pieces[i].phase = next;
+        next = (next + pieces[i].letters) % key_length;
+    }
+
+    run_pieces(encrypt_worker, pieces, threads);
+    *phase = next;
+}
+
+bool vigenere_stream_init(vigenere_stream *stream, const char *key,
+    bool decrypt)
+{
+    stream->phase = 0;
+    stream->threads = 1;
+    return vigenere_key_init(&stream->key, key, decrypt);
+}
+
+void vigenere_stream_update(vigenere_stream *stream, const char *in,
+    char *out, size_t len)
+{
+    vigenere_rotate_parallel(in, out, len, &stream->key, &stream->phase,
+        stream->threads);
+}
+
+void vigenere_stream_apply(vigenere_stream *stream, char *text, size_t len)
+{
+    vigenere_stream_update(stream, text, text, len);
+}
+
+void vigenere_stream_reset(vigenere_stream *stream)
+{
+    stream->phase = 0;
+}
+
+void vigenere_stream_free(vigenere_stream *stream)
+{
+    vigenere_key_free(&stream->key);
+}
@@ -0,0 +1,250 @@
+/**
+ * cipher.h
+ *
+ * Caesar and vigenere cypher library. Everything works on (char *,
+ * size_t) spans, in place or from one buffer to another, without any
+ * I/O or per-call allocation, so it can be linked into other programs
+ * as well as the caesar and vigenere tools: compile cipher.c alongside
+ * them and link with -pthread.
+ */
+
+#ifndef CIPHER_H
+#define CIPHER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Byte b rotated by k places, as a constant expression. Letters keep
+ * their case, everything else maps to itself.
+ */
+#define CAESAR_BYTE(b, k) \
+    ((unsigned int) (((b) | 0x20) - 'a') < 26 \
+        ? ((((b) | 0x20) - 'a' + (k)) % 26 + 'A') | ((b) & 0x20) \
+        : (b))
+
+#define CAESAR_ROW(r, k) \
+    CAESAR_BYTE(r + 0, k), CAESAR_BYTE(r + 1, k), CAESAR_BYTE(r + 2, k), \
+    CAESAR_BYTE(r + 3, k), CAESAR_BYTE(r + 4, k), CAESAR_BYTE(r + 5, k), \
+    CAESAR_BYTE(r + 6, k), CAESAR_BYTE(r + 7, k), CAESAR_BYTE(r + 8, k), \
+    CAESAR_BYTE(r + 9, k), CAESAR_BYTE(r + 10, k), CAESAR_BYTE(r + 11, k), \
+    CAESAR_BYTE(r + 12, k), CAESAR_BYTE(r + 13, k), CAESAR_BYTE(r + 14, k), \
+    CAESAR_BYTE(r + 15, k)
+
+/**
+ * Initialiser for a 256 entry translation table rotating by k, built
+ * entirely at compile time, e.g.
+ *
+ *     static const unsigned char rot13[256] = CAESAR_TABLE(13);
+ */
+#define CAESAR_TABLE(k) { \
+    CAESAR_ROW(0, k), CAESAR_ROW(16, k), CAESAR_ROW(32, k), \
+    CAESAR_ROW(48, k), CAESAR_ROW(64, k), CAESAR_ROW(80, k), \
+    CAESAR_ROW(96, k), CAESAR_ROW(112, k), CAESAR_ROW(128, k), \
+    CAESAR_ROW(144, k), CAESAR_ROW(160, k), CAESAR_ROW(176, k), \
+    CAESAR_ROW(192, k), CAESAR_ROW(208, k), CAESAR_ROW(224, k), \
+    CAESAR_ROW(240, k) }
+
+// translation tables for every caesar key 0..25, in read-only data
+extern const unsigned char caesar_tables[26][256];
+
+// vigenere key compiled to one translation table per key letter,
+// encrypting or decrypting
+typedef struct
+{
+    size_t length;                  // letters in the key
+    const unsigned char **tables;   // caesar_tables row for each letter
+}
+vigenere_key;
+
+/**
+ * Normalises any int key into 0..25, so negative and large keys behave.
+ *
+ * @param int key The key to normalise
+ *
+ * @return int The equivalent key in 0..25
+ */
+int caesar_key(int key);
+
+/**
+ * Maps every byte at in through table and stores the result in out, one
+ * table load per byte. in and out may be the same buffer.
+ *
+ * @param const char* in The bytes to be translated
+ * @param char* out Where to store the translated bytes
+ * @param size_t len The number of bytes to translate
+ * @param const unsigned char* table 256 entry translation table
+ *
+ * @return void
+ */
+void translate(const char *in, char *out, size_t len,
+    const unsigned char table[256]);
+
+/**
+ * Rotates every ascii letter in the len bytes at in by key places,
+ * preserving case, and stores the result in out. All other bytes are
+ * copied unchanged. in and out may be the same buffer.
+ *
+ * @param const char* in The bytes to be encrypted
+ * @param char* out Where to store the encrypted bytes
+ * @param size_t len The number of bytes to encrypt
+ * @param int key The key to rotate the characters by
+ *
+ * @return void
+ */
+void caesar_rotate(const char *in, char *out, size_t len, int key);
+
+/**
+ * Encrypts len bytes at text in place with the caesar cypher.
+ *
+ * @param char* text The bytes to encrypt
+ * @param size_t len The number of bytes
+ * @param int key The key to rotate the characters by
+ *
+ * @return void
+ */
+void caesar_encrypt(char *text, size_t len, int key);
+
+/**
+ * Decrypts len bytes at text in place, undoing caesar_encrypt.
+ *
+ * @param char* text The bytes to decrypt
+ * @param size_t len The number of bytes
+ * @param int key The key the text was encrypted with
+ *
+ * @return void
+ */
+void caesar_decrypt(char *text, size_t len, int key);
+
+/**
+ * Compiles key into its per-letter translation tables. A decrypting
+ * schedule rotates each letter back by its key letter instead.
+ *
+ * @param vigenere_key* schedule The schedule to fill in
+ * @param const char* key The key, alphabetical characters only
+ * @param bool decrypt Whether the schedule decrypts
+ *
+ * @return bool false if key is empty, not alphabetical or out of memory
+ */
+bool vigenere_key_init(vigenere_key *schedule, const char *key, bool decrypt);
+
+/**
+ * Frees a schedule filled in by vigenere_key_init.
+ *
+ * @param vigenere_key* schedule The schedule to free
+ *
+ * @return void
+ */
+void vigenere_key_free(vigenere_key *schedule);
+
+/**
+ * Encrypts the len bytes at in with the vigenere cypher and stores the
+ * result in out. Only letters advance the key, so *phase holds the index
+ * into key of the next letter and is updated on return; passing the same
+ * phase to consecutive calls encrypts a long text piece by piece.
+ *
+ * @param const char* in The bytes to be encrypted
+ * @param char* out Where to store the encrypted bytes
+ * @param size_t len The number of bytes to encrypt
+ * @param const vigenere_key* key The compiled key
+ * @param size_t* phase The position in key of the next letter
+ *
+ * @return void
+ */
+void vigenere_rotate(const char *in, char *out, size_t len,
+    const vigenere_key *key, size_t *phase);
+
+/**
+ * Counts the ascii letters in the len bytes at in.
+ *
+ * @param const char* in The bytes to count
+ * @param size_t len The number of bytes
+ *
+ * @return size_t The number of letters
+ */
+size_t count_letters(const char *in, size_t len);
+
+/**
+ * Same as vigenere_rotate, but splits the input into one piece per
+ * thread. A first pass counts the letters in every piece; an exclusive
+ * prefix sum over those counts gives each piece the key position it
+ * starts at, so all pieces are then encrypted at once. The output is
+ * identical to vigenere_rotate. Small inputs are encrypted serially.
+ *
+ * @param const char* in The bytes to be encrypted
+ * @param char* out Where to store the encrypted bytes
+ * @param size_t len The number of bytes to encrypt
+ * @param const vigenere_key* key The compiled key
+ * @param size_t* phase The position in key of the next letter
+ * @param int threads The number of threads to use
+ *
+ * @return void
+ */
+void vigenere_rotate_parallel(const char *in, char *out, size_t len,
+    const vigenere_key *key, size_t *phase, int threads);
+
+// vigenere cypher state carried from one span of a text to the next
+typedef struct
+{
+    vigenere_key key;   // compiled key
+    size_t phase;       // position in key of the next letter
+    int threads;        // threads used on large spans, 1 by default
+}
+vigenere_stream;
+
+/**
+ * Sets up a stream that encrypts, or decrypts, with key from its start.
+ *
+ * @param vigenere_stream* stream The stream to set up
+ * @param const char* key The key, alphabetical characters only
+ * @param bool decrypt Whether the stream decrypts
+ *
+ * @return bool false if key is empty, not alphabetical or out of memory
+ */
+bool vigenere_stream_init(vigenere_stream *stream, const char *key,
+    bool decrypt);
+
+/**
+ * Encrypts or decrypts the next len bytes of the stream's text from in
+ * into out, which may be the same buffer.
+ *
+ * @param vigenere_stream* stream The stream
+ * @param const char* in The next bytes of the text
+ * @param char* out Where to store the result
+ * @param size_t len The number of bytes
+ *
+ * @return void
+ */
+void vigenere_stream_update(vigenere_stream *stream, const char *in,
+    char *out, size_t len);
+
+/**
+ * Encrypts or decrypts the next len bytes of the stream's text in place.
+ *
+ * @param vigenere_stream* stream The stream
+ * @param char* text The next bytes of the text
+ * @param size_t len The number of bytes
+ *
+ * @return void
+ */
+void vigenere_stream_apply(vigenere_stream *stream, char *text, size_t len);
+
+/**
+ * Starts the stream over at the first letter of the key.
+ *
+ * @param vigenere_stream* stream The stream
+ *
+ * @return void
+ */
+void vigenere_stream_reset(vigenere_stream *stream);
+
+/**
+ * Frees a stream set up by vigenere_stream_init.
+ *
+ * @param vigenere_stream* stream The stream
+ *
+ * @return void
+ */
+void vigenere_stream_free(vigenere_stream *stream);
+
+#endif
@@ -0,0 +1,496 @@
+/**
+ * cipherd.c
+ *
+ * Long-running cypher daemon. Listens on a unix domain socket and
+ * answers pipelined requests (see cipherd.h), so a stream of small
+ * records costs one process, not one per record.
+ *
+ * Whatever a client has sent, up to a fair share per wakeup, is read at
+ * once and handled as a batch: each request is encrypted in place in the
+ * read buffer, consecutive requests with the same key share one key
+ * lookup, and all responses go back in a single write. Compiled vigenere
+ * keys are kept in a small cache between requests and connections.
+ *
+ * Usage: ./cipherd [--socket PATH]
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cipher.h"
+#include "cipherd.h"
+
+// most clients connected at once
+#define MAX_CLIENTS 1024
+
+// bytes asked for per read, and most read from one client per wakeup
+#define READ_SIZE (256 * 1024)
+#define MAX_READ (4 * READ_SIZE)
+
+// compiled keys kept between requests, and how many slots a key may use
+#define CACHE_SIZE 256
+#define CACHE_WAYS 4
+
+// a key as it appears in requests, and what it compiles to
+typedef struct
+{
+    bool used;
+    uint8_t cipher;
+    uint8_t decrypt;
+    uint16_t key_len;
+    char key[CIPHERD_MAX_KEY + 1];
+    int shift;                  // caesar
+    vigenere_key schedule;      // vigenere
+    unsigned long last_used;
+}
+cached_key;
+
+// one connection and its buffered input and output
+typedef struct
+{
+    int fd;
+    char *in;
+    size_t in_len;
+    size_t in_cap;
+    char *out;
+    size_t out_len;
+    size_t out_sent;
+    size_t out_cap;
+    bool closing;       // input has ended, close once output is sent
+}
+client;
+
+// the key cache
+cached_key cache[CACHE_SIZE];
+unsigned long cache_clock = 0;
+
+// set by SIGINT and SIGTERM
+volatile sig_atomic_t stopping = 0;
+
+// prototypes
+int listen_on(const char *path);
+void serve(int listener);
+bool handle_input(client *c);
+const cached_key *lookup_key(const cipherd_request *header, const char *key);
+bool append_output(client *c, const void *data, size_t len);
+bool flush_output(client *c);
+bool keep_client(const client *c);
+void drop_client(client *c);
+void stop(int signal);
+
+int main(int argc, char *argv[])
+{
+    const char *path = CIPHERD_SOCKET;
+
+    if (argc == 3 && strcmp(argv[1], "--socket") == 0)
+    {
+        path = argv[2];
+    }
+    else if (argc != 1)
+    {
+        printf("Usage: ./cipherd [--socket PATH]\n");
+        return 1;
+    }
+
+    int listener = listen_on(path);
+    if (listener < 0)
+    {
+        printf("Error! %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    // shut down cleanly, and never die writing to a vanished client
+    struct sigaction sa = {0};
+    sa.sa_handler = stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    serve(listener);
+
+    close(listener);
+    unlink(path);
+    return 0;
+}
+
+/**
+ * Creates a non-blocking listening socket at path, replacing any stale
+ * socket file left there.
+ */
+int listen_on(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    unlink(path);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0
+        || listen(fd, SOMAXCONN) < 0)
+    {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Accepts clients and answers their requests until stopped.
+ */
+void serve(int listener)
+{
+    static client clients[MAX_CLIENTS];
+    static struct pollfd fds[MAX_CLIENTS + 1];
+    int count = 0;
+
+    while (!stopping)
+    {
+        // stop reading from clients that are not keeping up
+        fds[0] = (struct pollfd) {listener, count < MAX_CLIENTS ? POLLIN : 0, 0};
+        for (int i = 0; i < count; i++)
+        {
+            bool backed_up = clients[i].out_len > 0;
+            fds[i + 1] = (struct pollfd) {clients[i].fd,
+                backed_up ? POLLOUT : POLLIN, 0};
+        }
+
+        if (poll(fds, count + 1, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("poll");
+            return;
+        }
+
+        for (int i = count - 1; i >= 0; i--)
+        {
+            short events = fds[i + 1].revents;
+            bool ok = true;
+
+            if (events & POLLOUT)
+            {
+                ok = flush_output(&clients[i]) && keep_client(&clients[i]);
+            }
+            else if (events & (POLLIN | POLLHUP | POLLERR))
+            {
+                ok = handle_input(&clients[i]);
+            }
+
+            // swap the last client into the gap
+            if (!ok)
+            {
+                drop_client(&clients[i]);
+                clients[i] = clients[--count];
+            }
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            int fd;
+            while (count < MAX_CLIENTS
+                && (fd = accept4(listener, NULL, NULL,
+                    SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+            {
+                clients[count++] = (client) {.fd = fd};
+            }
+        }
+    }
+
+    while (count > 0)
+    {
+        drop_client(&clients[--count]);
+    }
+}
+
+/**
+ * Reads what the client has sent, up to MAX_READ bytes so that no client
+ * holds up the others, answers every complete request in it and starts
+ * sending the answers. Returns false if the client should be dropped,
+ * which at the end of its input waits until every answer has been sent.
+ */
+bool handle_input(client *c)
+{
+    // read until the socket is drained or this wakeup's share is in
+    bool eof = false;
+    size_t got = 0;
+    while (got < MAX_READ)
+    {
+        if (c->in_cap - c->in_len < READ_SIZE)
+        {
+            size_t cap = c->in_cap * 2 > c->in_len + READ_SIZE
+                ? c->in_cap * 2 : c->in_len + READ_SIZE;
+            char *in = realloc(c->in, cap);
+            if (in == NULL)
+            {
+                return false;
+            }
+            c->in = in;
+            c->in_cap = cap;
+        }
+
+        ssize_t n = read(c->fd, c->in + c->in_len, c->in_cap - c->in_len);
+        if (n == 0)
+        {
+            eof = true;
+            break;
+        }
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN)
+            {
+                break;
+            }
+            return false;
+        }
+        c->in_len += n;
+        got += n;
+    }
+
+    // answer every complete request, a partial one at eof never will be
+    size_t done = 0;
+    cipherd_request last;
+    const char *last_key = NULL;
+    const cached_key *schedule = NULL;
+    while (c->in_len - done >= sizeof(cipherd_request))
+    {
+        // requests need not be aligned in the buffer
+        cipherd_request header;
+        memcpy(&header, c->in + done, sizeof(header));
+        if (header.magic != CIPHERD_MAGIC || header.key_len > CIPHERD_MAX_KEY
+            || header.payload_len > CIPHERD_MAX_PAYLOAD)
+        {
+            return false;
+        }
+
+        size_t size = sizeof(header) + header.key_len + header.payload_len;
+        if (c->in_len - done < size)
+        {
+            break;
+        }
+        const char *key = c->in + done + sizeof(header);
+        char *payload = (char *) key + header.key_len;
+
+        // requests with the last request's key reuse its lookup
+        if (last_key == NULL || last.cipher != header.cipher
+            || last.decrypt != header.decrypt || last.key_len != header.key_len
+            || memcmp(last_key, key, header.key_len) != 0)
+        {
+            schedule = lookup_key(&header, key);
+        }
+        last = header;
+        last_key = key;
+
+        cipherd_response response = {CIPHERD_BAD_KEY, 0};
+        if (schedule != NULL)
+        {
+            response = (cipherd_response) {CIPHERD_OK, header.payload_len};
+            if (schedule->cipher == CIPHERD_CAESAR)
+            {
+                caesar_encrypt(payload, header.payload_len, schedule->shift);
+            }
+            else
+            {
+                size_t phase = 0;
+                vigenere_rotate(payload, payload, header.payload_len,
+                    &schedule->schedule, &phase);
+            }
+        }
+
+        if (!append_output(c, &response, sizeof(response))
+            || !append_output(c, payload, response.payload_len))
+        {
+            return false;
+        }
+        done += size;
+    }
+
+    // keep any partial request for next time
+    memmove(c->in, c->in + done, c->in_len - done);
+    c->in_len -= done;
+
+    c->closing = eof;
+    return flush_output(c) && keep_client(c);
+}
+
+/**
+ * Finds the compiled form of a request's key, compiling and caching it
+ * if it is new. Returns NULL if the key is not valid.
+ */
+const cached_key *lookup_key(const cipherd_request *header, const char *key)
+{
+    if (header->cipher != CIPHERD_CAESAR && header->cipher != CIPHERD_VIGENERE)
+    {
+        return NULL;
+    }
+
+    // hash the key, FNV-1a
+    uint32_t hash = 2166136261u ^ header->cipher ^ (header->decrypt << 8);
+    for (int i = 0; i < header->key_len; i++)
+    {
+        hash = (hash ^ (unsigned char) key[i]) * 16777619u;
+    }
+
+    // look in the key's few slots, remembering the least recently used
+    cached_key *victim = NULL;
+    for (int way = 0; way < CACHE_WAYS; way++)
+    {
+        cached_key *entry = &cache[(hash + way) % CACHE_SIZE];
+        if (entry->used && entry->cipher == header->cipher
+            && entry->decrypt == header->decrypt
+            && entry->key_len == header->key_len
+            && memcmp(entry->key, key, header->key_len) == 0)
+        {
+            entry->last_used = ++cache_clock;
+            return entry;
+        }
+        if (victim == NULL || !entry->used
+            || (victim->used && entry->last_used < victim->last_used))
+        {
+            victim = entry;
+        }
+    }
+
+    // compile it first, so that a key that is not valid evicts nothing
+    cached_key entry = {
+        .used = true,
+        .cipher = header->cipher,
+        .decrypt = header->decrypt,
+        .key_len = header->key_len,
+        .last_used = ++cache_clock,
+    };
+    memcpy(entry.key, key, header->key_len);
+    entry.key[header->key_len] = '\0';
+
+    if (header->cipher == CIPHERD_CAESAR)
+    {
+        // reduced a digit at a time, so any number of digits is exact
+        int shift = 0;
+        for (int i = 0; i < header->key_len; i++)
+        {
+            if (entry.key[i] < '0' || entry.key[i] > '9')
+            {
+                return NULL;
+            }
+            shift = (shift * 10 + entry.key[i] - '0') % 26;
+        }
+        if (header->key_len == 0)
+        {
+            return NULL;
+        }
+        entry.shift = caesar_key(header->decrypt ? -shift : shift);
+    }
+    else if (!vigenere_key_init(&entry.schedule, entry.key, header->decrypt))
+    {
+        return NULL;
+    }
+
+    // then into the victim's slot
+    if (victim->used && victim->cipher == CIPHERD_VIGENERE)
+    {
+        vigenere_key_free(&victim->schedule);
+    }
+    *victim = entry;
+    return victim;
+}
+
+/**
+ * Queues len bytes to be sent to the client.
+ */
+bool append_output(client *c, const void *data, size_t len)
+{
+    if (c->out_cap - c->out_len < len)
+    {
+        size_t cap = c->out_cap * 2 > c->out_len + len
+            ? c->out_cap * 2 : c->out_len + len;
+        char *out = realloc(c->out, cap);
+        if (out == NULL)
+        {
+            return false;
+        }
+        c->out = out;
+        c->out_cap = cap;
+    }
+    memcpy(c->out + c->out_len, data, len);
+    c->out_len += len;
+    return true;
+}
+
+/**
+ * Sends as much queued output as the socket takes without blocking.
+ */
+bool flush_output(client *c)
+{
+    while (c->out_sent < c->out_len)
+    {
+        ssize_t n = write(c->fd, c->out + c->out_sent, c->out_len - c->out_sent);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno == EAGAIN;
+        }
+        c->out_sent += n;
+    }
+
+    c->out_len = 0;
+    c->out_sent = 0;
+    return true;
+}
+
+/**
+ * Returns false once a client whose input has ended has been sent
+ * everything queued for it.
+ */
+bool keep_client(const client *c)
+{
+    return !c->closing || c->out_len > 0;
+}
+
+/**
+ * Closes a client's connection and frees its buffers.
+ */
+void drop_client(client *c)
+{
+    close(c->fd);
+    free(c->in);
+    free(c->out);
+}
+
+/**
+ * Asks the main loop to stop.
+ */
+void stop(int signal)
+{
+    (void) signal;
+    stopping = 1;
+}
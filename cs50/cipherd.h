@@ -0,0 +1,52 @@
+/**
+ * cipherd.h
+ *
+ * Wire protocol of the cypher daemon. A client sends any number of
+ * requests down a unix domain socket without waiting, each a
+ * cipherd_request followed by key_len bytes of key and payload_len bytes
+ * of text; the daemon answers each, in order, with a cipherd_response
+ * followed by payload_len bytes of result. Fields are in host byte order,
+ * both ends being on the same machine.
+ */
+
+#ifndef CIPHERD_H
+#define CIPHERD_H
+
+#include <stdint.h>
+
+// socket the daemon listens on unless told otherwise
+#define CIPHERD_SOCKET "/tmp/cipherd.sock"
+
+// marks the start of every request
+#define CIPHERD_MAGIC 0x48504943
+
+// cyphers
+#define CIPHERD_CAESAR 0
+#define CIPHERD_VIGENERE 1
+
+// longest key and payload accepted
+#define CIPHERD_MAX_KEY 255
+#define CIPHERD_MAX_PAYLOAD (16 << 20)
+
+// response statuses
+#define CIPHERD_OK 0
+#define CIPHERD_BAD_KEY 1
+
+typedef struct
+{
+    uint32_t magic;         // CIPHERD_MAGIC
+    uint8_t cipher;         // CIPHERD_CAESAR or CIPHERD_VIGENERE
+    uint8_t decrypt;        // non-zero to decrypt
+    uint16_t key_len;       // bytes of key, caesar keys in decimal
+    uint32_t payload_len;   // bytes of text
+}
+cipherd_request;
+
+typedef struct
+{
+    uint32_t status;        // CIPHERD_OK or why not
+    uint32_t payload_len;   // bytes of result, 0 unless ok
+}
+cipherd_response;
+
+#endif
@@ -0,0 +1,328 @@
+/**
+ * cipherd_load.c
+ *
+ * Load generator for cipherd. Opens a number of connections, keeps a
+ * fixed number of requests in flight on each and reports requests per
+ * second and latency percentiles. Every response is checked against the
+ * library's own result.
+ *
+ * Usage: ./cipherd_load [--socket PATH] [--connections N] [--requests N]
+ *                       [--depth N] [--size BYTES] [--vigenere] [--key KEY]
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cipher.h"
+#include "cipherd.h"
+
+// one connection's work and results
+typedef struct
+{
+    int fd;
+    int requests;
+    sem_t window;           // requests that may still be sent
+    double *sent;           // when each request was sent
+    double *latency;        // how long each took
+    int errors;
+}
+connection;
+
+// the request every connection sends, and the answer expected
+const char *socket_path = CIPHERD_SOCKET;
+char *request;
+size_t request_len;
+char *expected;
+size_t payload_len;
+
+// prototypes
+double now(void);
+bool write_all(int fd, const char *buf, size_t len);
+bool read_all(int fd, char *buf, size_t len);
+void *sender(void *arg);
+void *receiver(void *arg);
+int compare_doubles(const void *a, const void *b);
+
+int main(int argc, char *argv[])
+{
+    int connections = 4;
+    int requests = 100000;
+    int depth = 32;
+    size_t size = 100;
+    bool vigenere = false;
+    const char *key = NULL;
+
+    // parse command-line args
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--socket") == 0)
+        {
+            socket_path = argv[++i];
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--connections") == 0)
+        {
+            connections = atoi(argv[++i]);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--requests") == 0)
+        {
+            requests = atoi(argv[++i]);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--depth") == 0)
+        {
+            depth = atoi(argv[++i]);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--size") == 0)
+        {
+            size = strtoul(argv[++i], NULL, 10);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--key") == 0)
+        {
+            key = argv[++i];
+        }
+        else if (strcmp(argv[i], "--vigenere") == 0)
+        {
+            vigenere = true;
+        }
+        else
+        {
+            printf("Usage: ./cipherd_load [--socket PATH] [--connections N] "
+                "[--requests N] [--depth N] [--size BYTES] [--vigenere] "
+                "[--key KEY]\n");
+            return 1;
+        }
+    }
+    if (key == NULL)
+    {
+        key = vigenere ? "bacon" : "13";
+    }
+    if (connections < 1 || requests < 1 || depth < 1
+        || size > CIPHERD_MAX_PAYLOAD || strlen(key) > CIPHERD_MAX_KEY)
+    {
+        printf("Error! Bad arguments.\n");
+        return 1;
+    }
+
+    // build the request and the response it should get
+    cipherd_request header = {CIPHERD_MAGIC,
+        vigenere ? CIPHERD_VIGENERE : CIPHERD_CAESAR, 0, strlen(key), size};
+    payload_len = size;
+    request_len = sizeof(header) + header.key_len + size;
+    request = malloc(request_len);
+    expected = malloc(size + 1);
+    if (request == NULL || expected == NULL)
+    {
+        printf("Error! Out of memory.\n");
+        return 1;
+    }
+
+    const char sample[] = "The quick brown fox, jumps over THE lazy dog. ";
+    for (size_t i = 0; i < size; i++)
+    {
+        expected[i] = sample[i % (sizeof(sample) - 1)];
+    }
+    memcpy(request, &header, sizeof(header));
+    memcpy(request + sizeof(header), key, header.key_len);
+    memcpy(request + sizeof(header) + header.key_len, expected, size);
+
+    if (vigenere)
+    {
+        vigenere_stream stream;
+        if (!vigenere_stream_init(&stream, key, false))
+        {
+            printf("Error! Key must only contain alphabetical characters.\n");
+            return 1;
+        }
+        vigenere_stream_apply(&stream, expected, size);
+        vigenere_stream_free(&stream);
+    }
+    else
+    {
+        caesar_encrypt(expected, size, atoi(key));
+    }
+
+    // connect everything before starting the clock
+    connection *conns = calloc(connections, sizeof(connection));
+    pthread_t *threads = calloc(connections * 2, sizeof(pthread_t));
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+    for (int i = 0; i < connections; i++)
+    {
+        conns[i].fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (conns[i].fd < 0
+            || connect(conns[i].fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+        {
+            printf("Error! %s: %s\n", socket_path, strerror(errno));
+            return 1;
+        }
+        conns[i].requests = requests;
+        conns[i].sent = malloc(requests * sizeof(double));
+        conns[i].latency = malloc(requests * sizeof(double));
+        if (conns[i].sent == NULL || conns[i].latency == NULL)
+        {
+            printf("Error! Out of memory.\n");
+            return 1;
+        }
+        sem_init(&conns[i].window, 0, depth);
+    }
+
+    double start = now();
+    for (int i = 0; i < connections; i++)
+    {
+        pthread_create(&threads[2 * i], NULL, sender, &conns[i]);
+        pthread_create(&threads[2 * i + 1], NULL, receiver, &conns[i]);
+    }
+    for (int i = 0; i < connections * 2; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = now() - start;
+
+    // gather every latency to find the percentiles
+    size_t total = (size_t) connections * requests;
+    double *all = malloc(total * sizeof(double));
+    int errors = 0;
+    for (int i = 0; i < connections; i++)
+    {
+        memcpy(all + (size_t) i * requests, conns[i].latency,
+            requests * sizeof(double));
+        errors += conns[i].errors;
+        close(conns[i].fd);
+    }
+    qsort(all, total, sizeof(double), compare_doubles);
+
+    printf("requests=%zu seconds=%.3f requests_per_sec=%.0f "
+        "p50_us=%.1f p99_us=%.1f errors=%d\n",
+        total, elapsed, total / elapsed, all[total / 2] * 1e6,
+        all[(size_t) (total * 0.99)] * 1e6, errors);
+    return errors == 0 ? 0 : 1;
+}
+
+/**
+ * Returns the current time in seconds.
+ */
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Writes all of buf, returning false on error.
+ */
+bool write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno != EINTR)
+        {
+            return false;
+        }
+        if (n > 0)
+        {
+            buf += n;
+            len -= n;
+        }
+    }
+    return true;
+}
+
+/**
+ * Reads exactly len bytes, returning false on error or end of file.
+ */
+bool read_all(int fd, char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = read(fd, buf, len);
+        if (n == 0 || (n < 0 && errno != EINTR))
+        {
+            return false;
+        }
+        if (n > 0)
+        {
+            buf += n;
+            len -= n;
+        }
+    }
+    return true;
+}
+
+/**
+ * Sends a connection's requests, never more than the window allows
+ * ahead of the responses.
+ */
+void *sender(void *arg)
+{
+    connection *c = arg;
+    for (int i = 0; i < c->requests; i++)
+    {
+        sem_wait(&c->window);
+        c->sent[i] = now();
+        if (!write_all(c->fd, request, request_len))
+        {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Reads a connection's responses in order, timing and checking each.
+ */
+void *receiver(void *arg)
+{
+    connection *c = arg;
+    char *payload = malloc(payload_len + 1);
+
+    for (int i = 0; i < c->requests; i++)
+    {
+        cipherd_response response;
+        if (payload == NULL || !read_all(c->fd, (char *) &response, sizeof(response))
+            || response.status != CIPHERD_OK || response.payload_len != payload_len
+            || !read_all(c->fd, payload, payload_len))
+        {
+            // count the rest as failed and unblock the sender
+            shutdown(c->fd, SHUT_RDWR);
+            c->errors += c->requests - i;
+            for (; i < c->requests; i++)
+            {
+                c->latency[i] = 0.0;
+                sem_post(&c->window);
+            }
+            break;
+        }
+
+        c->latency[i] = now() - c->sent[i];
+        if (memcmp(payload, expected, payload_len) != 0)
+        {
+            c->errors++;
+        }
+        sem_post(&c->window);
+    }
+
+    free(payload);
+    return NULL;
+}
+
+/**
+ * Orders doubles for qsort.
+ */
+int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
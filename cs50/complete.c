@@ -0,0 +1,371 @@
+/**
+ * complete.c
+ *
+ * Complete table of every 3 x 3 board.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "complete.h"
+#include "outbuf.h"
+
+// cells on the board
+#define CELLS (COMPLETE_D * COMPLETE_D)
+
+// factorials, the weights of a Lehmer code's digits
+static const int factorial[CELLS] = {1, 1, 2, 6, 24, 120, 720, 5040, 40320};
+
+/**
+ * Returns the Lehmer code of an arrangement: every cell's digit counts
+ * the later cells holding smaller values.
+ */
+static int rank_board(const uint8_t cells[])
+{
+    int rank = 0;
+    for (int i = 0; i < CELLS; i++)
+    {
+        int smaller = 0;
+        for (int j = i + 1; j < CELLS; j++)
+        {
+            smaller += cells[j] < cells[i];
+        }
+        rank += smaller * factorial[CELLS - 1 - i];
+    }
+    return rank;
+}
+
+/**
+ * Turns a Lehmer code back into an arrangement, returning the cell of
+ * the blank.
+ */
+static int unrank_board(int rank, uint8_t cells[])
+{
+    bool used[CELLS] = { false };
+    int blank = 0;
+    for (int i = 0; i < CELLS; i++)
+    {
+        int smaller = rank / factorial[CELLS - 1 - i];
+        rank %= factorial[CELLS - 1 - i];
+        int value = 0;
+        while (used[value] || smaller > 0)
+        {
+            smaller -= !used[value];
+            value++;
+        }
+        used[value] = true;
+        cells[i] = value;
+        if (value == 0)
+        {
+            blank = i;
+        }
+    }
+    return blank;
+}
+
+/**
+ * Returns a board's entry.
+ */
+static inline int entry(const uint8_t *entries, int rank)
+{
+    return entries[rank / 4] >> (rank % 4 * 2) & 3;
+}
+
+/**
+ * Calls visit with the rank of every board one move from cells, whose
+ * blank is at blank, and the tile that moves, until visit returns true.
+ * Returns whether it did.
+ */
+static bool neighbors(uint8_t cells[], int blank,
+    bool (*visit)(int rank, int tile, void *state), void *state)
+{
+    static const int steps[4][2] = {{-1, 0}, {0, -1}, {0, 1}, {1, 0}};
+    for (int i = 0; i < 4; i++)
+    {
+        int r = blank / COMPLETE_D + steps[i][0];
+        int c = blank % COMPLETE_D + steps[i][1];
+        if (r < 0 || r >= COMPLETE_D || c < 0 || c >= COMPLETE_D)
+        {
+            continue;
+        }
+        int cell = r * COMPLETE_D + c;
+        int tile = cells[cell];
+        cells[blank] = tile;
+        cells[cell] = 0;
+        int rank = rank_board(cells);
+        cells[cell] = tile;
+        cells[blank] = 0;
+        if (visit(rank, tile, state))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// a breadth first search over ranks
+typedef struct
+{
+    uint8_t *entries;
+    int *queue;
+    int tail;
+    int distance;               // of the boards being expanded
+}
+bfs;
+
+/**
+ * Queues a board not seen before at the next distance.
+ */
+static bool enqueue(int rank, int tile, void *state)
+{
+    (void) tile;
+    bfs *b = state;
+    if (entry(b->entries, rank) == COMPLETE_UNREACHABLE)
+    {
+        int shift = rank % 4 * 2;
+        b->entries[rank / 4] &= ~(3 << shift);
+        b->entries[rank / 4] |= (b->distance + 1) % 3 << shift;
+        b->queue[b->tail++] = rank;
+    }
+    return false;
+}
+
+// a step down the table
+typedef struct
+{
+    const uint8_t *entries;
+    int want;                   // entry of the board one move closer
+    int rank;
+    int tile;
+}
+step;
+
+/**
+ * Stops at the neighbor one move closer to the goal.
+ */
+static bool closer(int rank, int tile, void *state)
+{
+    step *s = state;
+    if (entry(s->entries, rank) != s->want)
+    {
+        return false;
+    }
+    s->rank = rank;
+    s->tile = tile;
+    return true;
+}
+
+/**
+ * Copies a puzzle's cells, returning false unless it is 3 x 3.
+ */
+static bool copy_cells(const puzzle *p, uint8_t cells[])
+{
+    if (p->d != COMPLETE_D)
+    {
+        return false;
+    }
+    memcpy(cells, p->cells, CELLS);
+    return true;
+}
+
+bool complete_build(complete_table *table)
+{
+    uint8_t *entries = malloc(COMPLETE_BYTES);
+    int *queue = malloc(COMPLETE_STATES / 2 * sizeof(int));
+    if (entries == NULL || queue == NULL)
+    {
+        free(entries);
+        free(queue);
+        errno = ENOMEM;
+        return false;
+    }
+    memset(entries, 0xff, COMPLETE_BYTES);
+
+    // from the goal, a distance at a time
+    uint8_t cells[CELLS] = {1, 2, 3, 4, 5, 6, 7, 8, 0};
+    bfs b = {.entries = entries, .queue = queue, .tail = 0, .distance = -1};
+    enqueue(rank_board(cells), 0, &b);
+    int head = 0;
+    for (b.distance = 0; head < b.tail; b.distance++)
+    {
+        int end = b.tail;
+        for (; head < end; head++)
+        {
+            int blank = unrank_board(queue[head], cells);
+            neighbors(cells, blank, enqueue, &b);
+        }
+    }
+
+    *table = (complete_table) {.entries = entries, .reachable = b.tail,
+        .longest = b.distance - 1};
+    free(queue);
+    return true;
+}
+
+bool complete_write(const complete_table *table, const char *path)
+{
+    complete_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, COMPLETE_MAGIC, sizeof(header.magic));
+    header.version = COMPLETE_VERSION;
+    header.d = COMPLETE_D;
+    header.states = COMPLETE_STATES;
+    header.reachable = table->reachable;
+    header.longest = table->longest;
+
+    outbuf out;
+    if (!outbuf_open_replace(&out, path, OUTBUF_SIZE))
+    {
+        return false;
+    }
+    if (!outbuf_append(&out, (char *) &header, sizeof(header))
+        || !outbuf_append(&out, (const char *) table->entries, COMPLETE_BYTES))
+    {
+        int saved = errno;
+        outbuf_close(&out);
+        errno = saved;
+        return false;
+    }
+    return outbuf_replace(&out);
+}
+
+bool complete_open(complete_table *table, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0
+        && (size_t) st.st_size == sizeof(complete_header) + COMPLETE_BYTES)
+    {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    else
+    {
+        errno = EINVAL;
+    }
+    int saved = errno;
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        errno = saved;
+        return false;
+    }
+
+    const complete_header *header = map;
+    if (memcmp(header->magic, COMPLETE_MAGIC, sizeof(header->magic)) != 0
+        || header->version != COMPLETE_VERSION || header->d != COMPLETE_D
+        || header->states != COMPLETE_STATES
+        || header->longest > COMPLETE_LONGEST)
+    {
+        munmap(map, st.st_size);
+        errno = EINVAL;
+        return false;
+    }
+
+    *table = (complete_table) {
+        .entries = (const uint8_t *) (header + 1),
+        .reachable = header->reachable,
+        .longest = header->longest,
+        .map = map,
+        .map_len = st.st_size,
+    };
+    return true;
+}
+
+bool complete_load(complete_table *table, const char *path)
+{
+    if (complete_open(table, path))
+    {
+        return true;
+    }
+    if (errno != ENOENT || !complete_build(table))
+    {
+        return false;
+    }
+    // processes building it at once each rename a whole table into place
+    bool ok = complete_write(table, path);
+    int saved = errno;
+    complete_free(table);
+    if (!ok)
+    {
+        errno = saved;
+        return false;
+    }
+    return complete_open(table, path);
+}
+
+void complete_free(complete_table *table)
+{
+    if (table->map != NULL)
+    {
+        munmap(table->map, table->map_len);
+    }
+    else
+    {
+        free((uint8_t *) table->entries);
+    }
+    memset(table, 0, sizeof(*table));
+}
+
+int complete_hint(const complete_table *table, const puzzle *p)
+{
+    uint8_t cells[CELLS];
+    if (!copy_cells(p, cells))
+    {
+        return -1;
+    }
+    int rank = rank_board(cells);
+    int here = entry(table->entries, rank);
+    if (here == COMPLETE_UNREACHABLE)
+    {
+        return -1;
+    }
+    step s = {.entries = table->entries, .want = (here + 2) % 3};
+    if (!neighbors(cells, p->blank, closer, &s))
+    {
+        return 0;
+    }
+    return s.tile;
+}
+
+int complete_solve(const complete_table *table, const puzzle *p,
+    uint8_t moves[])
+{
+    uint8_t cells[CELLS];
+    if (!copy_cells(p, cells))
+    {
+        return -1;
+    }
+    int blank = p->blank;
+    int rank = rank_board(cells);
+    int here = entry(table->entries, rank);
+    if (here == COMPLETE_UNREACHABLE)
+    {
+        return -1;
+    }
+
+    // the goal is the only board with no neighbor closer, and no walk
+    // to it is longer than the longest, whatever the table's entries say
+    int length = 0;
+    step s = {.entries = table->entries, .want = (here + 2) % 3};
+    while (length < table->longest && neighbors(cells, blank, closer, &s))
+    {
+        moves[length++] = s.tile;
+        blank = unrank_board(s.rank, cells);
+        s.want = (s.want + 2) % 3;
+    }
+    static const uint8_t goal[CELLS] = {1, 2, 3, 4, 5, 6, 7, 8, 0};
+    return memcmp(cells, goal, CELLS) == 0 ? length : -1;
+}
@@ -0,0 +1,139 @@
+/**
+ * complete.h
+ *
+ * Complete table of every 3 x 3 board, for solving them without any
+ * search. Boards are ranked by their Lehmer code, and every rank holds
+ * its board's distance from the goal modulo 3 in two bits. A move
+ * always changes the distance by exactly one, so the neighbor one
+ * closer is the one whose entry is one less, and a solution is a walk
+ * down the table. Files are mapped read-only and shared.
+ */
+
+#ifndef COMPLETE_H
+#define COMPLETE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "solver.h"
+
+// identifies a complete table file, and the layout version this code
+// writes
+#define COMPLETE_MAGIC "FIFT3X3"
+#define COMPLETE_VERSION 1
+
+// the board the table covers, its arrangements, and bytes of entries
+#define COMPLETE_D 3
+#define COMPLETE_STATES 362880
+#define COMPLETE_BYTES (COMPLETE_STATES / 4)
+
+// what an entry holds if its board cannot be solved
+#define COMPLETE_UNREACHABLE 3
+
+// most moves any 3 x 3 board needs
+#define COMPLETE_LONGEST 31
+
+// start of every complete table file, 64 bytes so the entries are cache
+// aligned
+typedef struct
+{
+    char magic[8];              // COMPLETE_MAGIC
+    uint32_t version;           // COMPLETE_VERSION
+    uint32_t d;                 // COMPLETE_D
+    uint64_t states;            // COMPLETE_STATES
+    uint64_t reachable;         // boards that can be solved
+    uint32_t longest;           // most moves any board needs
+    uint8_t reserved[28];
+}
+complete_header;
+
+// a complete table, built or mapped
+typedef struct
+{
+    const uint8_t *entries;     // four a byte, lowest bits first
+    uint64_t reachable;
+    int longest;
+    void *map;                  // the file, if mapped
+    size_t map_len;
+}
+complete_table;
+
+/**
+ * Fills in a table by a breadth first search back from the goal.
+ *
+ * @param complete_table* table The table to build
+ *
+ * @return bool false with errno set on failure
+ */
+bool complete_build(complete_table *table);
+
+/**
+ * Writes a table to a new file and renames it over path, so a process
+ * with the old file mapped, or reading it as it appears, never sees a
+ * part written table.
+ *
+ * @param const complete_table* table The table
+ * @param const char* path The file to create or replace
+ *
+ * @return bool false with errno set on failure
+ */
+bool complete_write(const complete_table *table, const char *path);
+
+/**
+ * Maps the table at path, checking its header against the file's size
+ * and that it claims no board needs more than COMPLETE_LONGEST moves.
+ *
+ * @param complete_table* table The table to fill in
+ * @param const char* path The file to map
+ *
+ * @return bool false with errno set on failure, EINVAL if not a
+ *         complete table
+ */
+bool complete_open(complete_table *table, const char *path);
+
+/**
+ * Maps the table at path, first building it and writing it there if
+ * there is no such file.
+ *
+ * @param complete_table* table The table to fill in
+ * @param const char* path The file to map or create
+ *
+ * @return bool false with errno set on failure
+ */
+bool complete_load(complete_table *table, const char *path);
+
+/**
+ * Unmaps or frees a table.
+ *
+ * @param complete_table* table The table
+ *
+ * @return void
+ */
+void complete_free(complete_table *table);
+
+/**
+ * Returns the tile to move first on a shortest way to the goal.
+ *
+ * @param const complete_table* table The table
+ * @param const puzzle* p A 3 x 3 puzzle
+ *
+ * @return int The tile, 0 if p is solved, -1 if it cannot be
+ */
+int complete_hint(const complete_table *table, const puzzle *p);
+
+/**
+ * Writes a shortest solution to moves by walking down the table, for no
+ * more than the table's longest number of moves.
+ *
+ * @param const complete_table* table The table
+ * @param const puzzle* p A 3 x 3 puzzle
+ * @param uint8_t* moves Room for COMPLETE_LONGEST moves
+ *
+ * @return int The number of moves, -1 if p cannot be solved or the walk
+ *         does not reach the goal, as with a corrupt table
+ */
+int complete_solve(const complete_table *table, const puzzle *p,
+    uint8_t moves[]);
+
+#endif
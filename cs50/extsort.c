@@ -0,0 +1,691 @@
+/**
+ * extsort.c
+ *
+ * External merge sort. The input is cut into runs of half the budget,
+ * each sorted in memory by sort(), whose scratch space takes the other
+ * half, and spilled to a temporary file. The runs are then merged through
+ * a loser tree, one comparison per level for every value. Each run is
+ * read through two buffers: while the merge works through one, a
+ * background thread reads the run's next stretch into the other. When
+ * the budget cannot give every run buffers big enough for sequential
+ * reads, the oldest runs are merged into longer ones first.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "extsort.h"
+#include "helpers.h"
+#include "sortindex.h"
+
+// smallest read buffer a run is merged through, below which seeks
+// between runs cost more than the reads
+#define MIN_RUN_BUFFER (256 << 10)
+
+// memory left for the process itself: code, stacks, the allocator
+#define PROCESS_RESERVE (4 << 20)
+
+// values merged between calls to the sink
+#define MERGE_OUT (1 << 18)
+
+// key of a run with nothing left, above every int
+#define EXHAUSTED INT64_MAX
+
+// a sorted run spilled to disk
+typedef struct
+{
+    int fd;
+    off_t size;
+}
+spill;
+
+// a run being merged, with its two buffers
+typedef struct
+{
+    int fd;
+    off_t offset;       // next byte to read, used only by whoever reads
+    off_t end;
+    int *buf[2];
+    size_t len[2];      // values in each buffer
+    bool ready[2];      // filled and waiting to be merged
+    int current;        // buffer being merged
+    size_t pos;         // next value in it
+}
+run;
+
+// state shared by a merge and its reader thread
+typedef struct
+{
+    run *runs;
+    int count;
+    size_t buf_values;
+    int *buffers;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int *queue;         // refills wanted, run * 2 + buffer
+    int head;
+    int tail;
+    bool threaded;      // a reader thread is running
+    bool stop;
+    int error;          // errno of a failed read, 0 if none
+    pthread_t reader;
+}
+merger;
+
+// where merged values go
+typedef bool (*merge_sink)(const int *values, size_t n, void *state);
+
+/**
+ * Writes len bytes, however many calls it takes.
+ */
+static bool write_all(int fd, const void *data, size_t len)
+{
+    const char *p = data;
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0)
+        {
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/**
+ * Reads up to len bytes, stopping early only at end of file. Returns the
+ * number read, -1 on error.
+ */
+static ssize_t read_full(int fd, void *buf, size_t len, off_t *offset)
+{
+    char *p = buf;
+    size_t done = 0;
+    while (done < len)
+    {
+        ssize_t n = offset != NULL
+            ? pread(fd, p + done, len - done, *offset + done)
+            : read(fd, p + done, len - done);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0)
+        {
+            return -1;
+        }
+        if (n == 0)
+        {
+            break;
+        }
+        done += n;
+    }
+    if (offset != NULL)
+    {
+        *offset += done;
+    }
+    return done;
+}
+
+/**
+ * Creates an unlinked temporary file in dir, so it goes away with its
+ * descriptor. Returns the descriptor, -1 on failure.
+ */
+static int create_spill(const char *dir)
+{
+    char path[strlen(dir) + sizeof("/findsort.XXXXXX")];
+    sprintf(path, "%s/findsort.XXXXXX", dir);
+    int fd = mkstemp(path);
+    if (fd >= 0)
+    {
+        unlink(path);
+    }
+    return fd;
+}
+
+/**
+ * Reads a run's next stretch into one of its buffers.
+ */
+static bool fill(run *r, int b, size_t buf_values)
+{
+    size_t want = buf_values * sizeof(int);
+    if ((off_t) want > r->end - r->offset)
+    {
+        want = r->end - r->offset;
+    }
+    ssize_t n = read_full(r->fd, r->buf[b], want, &r->offset);
+    r->len[b] = n > 0 ? n / sizeof(int) : 0;
+    return n == (ssize_t) want;
+}
+
+/**
+ * Reader thread, filling buffers in the order the merge emptied them.
+ */
+static void *reader(void *arg)
+{
+    merger *m = arg;
+    pthread_mutex_lock(&m->lock);
+    while (true)
+    {
+        while (m->head == m->tail && !m->stop)
+        {
+            pthread_cond_wait(&m->cond, &m->lock);
+        }
+        if (m->stop)
+        {
+            break;
+        }
+        int item = m->queue[m->head];
+        m->head = (m->head + 1) % (m->count + 1);
+        pthread_mutex_unlock(&m->lock);
+
+        run *r = &m->runs[item / 2];
+        bool ok = fill(r, item % 2, m->buf_values);
+        int error = ok ? 0 : errno ? errno : EIO;
+
+        pthread_mutex_lock(&m->lock);
+        r->ready[item % 2] = true;
+        if (error != 0)
+        {
+            m->error = error;
+        }
+        pthread_cond_broadcast(&m->cond);
+    }
+    pthread_mutex_unlock(&m->lock);
+    return NULL;
+}
+
+/**
+ * Asks for a run's buffer to be refilled, by the reader thread if there
+ * is one, else right away.
+ */
+static void refill(merger *m, int i, int b)
+{
+    run *r = &m->runs[i];
+    if (!m->threaded)
+    {
+        if (!fill(r, b, m->buf_values))
+        {
+            m->error = errno ? errno : EIO;
+        }
+        r->ready[b] = true;
+        return;
+    }
+
+    pthread_mutex_lock(&m->lock);
+    r->ready[b] = false;
+    m->queue[m->tail] = i * 2 + b;
+    m->tail = (m->tail + 1) % (m->count + 1);
+    pthread_cond_broadcast(&m->cond);
+    pthread_mutex_unlock(&m->lock);
+}
+
+/**
+ * Moves a run on to its other buffer once it has been filled, and has
+ * the one just finished refilled behind it.
+ */
+static bool next_buffer(merger *m, int i)
+{
+    run *r = &m->runs[i];
+    int b = 1 - r->current;
+
+    pthread_mutex_lock(&m->lock);
+    while (!r->ready[b] && m->error == 0)
+    {
+        pthread_cond_wait(&m->cond, &m->lock);
+    }
+    int error = m->error;
+    pthread_mutex_unlock(&m->lock);
+    if (error != 0)
+    {
+        errno = error;
+        return false;
+    }
+
+    int done = r->current;
+    r->current = b;
+    r->pos = 0;
+    if (r->len[b] > 0)
+    {
+        refill(m, i, done);
+    }
+    return true;
+}
+
+/**
+ * Sets up a merge of count spills, with buffers of buf_values each, and
+ * fills the first buffer of every run.
+ */
+static bool open_merger(merger *m, const spill spills[], int count,
+    size_t buf_values)
+{
+    *m = (merger) {.count = count, .buf_values = buf_values};
+    m->runs = calloc(count, sizeof(run));
+    m->queue = malloc((count + 1) * sizeof(int));
+    m->buffers = malloc(2 * count * buf_values * sizeof(int));
+    if (m->runs == NULL || m->queue == NULL || m->buffers == NULL)
+    {
+        free(m->runs);
+        free(m->queue);
+        free(m->buffers);
+        return false;
+    }
+    pthread_mutex_init(&m->lock, NULL);
+    pthread_cond_init(&m->cond, NULL);
+
+    for (int i = 0; i < count; i++)
+    {
+        run *r = &m->runs[i];
+        r->fd = spills[i].fd;
+        r->end = spills[i].size;
+        r->buf[0] = m->buffers + 2 * i * buf_values;
+        r->buf[1] = r->buf[0] + buf_values;
+        posix_fadvise(r->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        if (!fill(r, 0, buf_values))
+        {
+            m->error = errno ? errno : EIO;
+        }
+        r->ready[0] = true;
+    }
+
+    // read ahead from here on, or inline if no thread will start
+    m->threaded = pthread_create(&m->reader, NULL, reader, m) == 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (m->runs[i].len[0] > 0)
+        {
+            refill(m, i, 1);
+        }
+    }
+    return true;
+}
+
+/**
+ * Stops the reader thread and frees a merge's buffers.
+ */
+static void close_merger(merger *m)
+{
+    if (m->threaded)
+    {
+        pthread_mutex_lock(&m->lock);
+        m->stop = true;
+        pthread_cond_broadcast(&m->cond);
+        pthread_mutex_unlock(&m->lock);
+        pthread_join(m->reader, NULL);
+    }
+    pthread_mutex_destroy(&m->lock);
+    pthread_cond_destroy(&m->cond);
+    free(m->runs);
+    free(m->queue);
+    free(m->buffers);
+}
+
+/**
+ * Replays the matches on the path from leaf s to the root of a loser
+ * tree over k keys, leaving the loser of each in its node and the
+ * overall winner in tree[0].
+ */
+static void adjust(int tree[], const int64_t keys[], int k, int s)
+{
+    for (int t = (s + k) / 2; t > 0; t /= 2)
+    {
+        if (keys[s] > keys[tree[t]])
+        {
+            int loser = s;
+            s = tree[t];
+            tree[t] = loser;
+        }
+    }
+    tree[0] = s;
+}
+
+/**
+ * Returns the key of a run's next value.
+ */
+static inline int64_t head_key(const run *r)
+{
+    return r->pos < r->len[r->current] ? r->buf[r->current][r->pos]
+        : EXHAUSTED;
+}
+
+/**
+ * Merges every run of m, in order, into sink.
+ */
+static bool merge(merger *m, merge_sink sink, void *state)
+{
+    int k = m->count;
+    int64_t *keys = malloc((k + 1) * sizeof(int64_t));
+    int *tree = calloc(k, sizeof(int));
+    int *out = malloc(MERGE_OUT * sizeof(int));
+    if (keys == NULL || tree == NULL || out == NULL || m->error != 0)
+    {
+        free(keys);
+        free(tree);
+        free(out);
+        errno = m->error ? m->error : ENOMEM;
+        return false;
+    }
+
+    // a virtual leaf below every key fills the tree as it is built
+    for (int i = 0; i < k; i++)
+    {
+        keys[i] = head_key(&m->runs[i]);
+        tree[i] = k;
+    }
+    keys[k] = INT64_MIN;
+    for (int i = k - 1; i >= 0; i--)
+    {
+        adjust(tree, keys, k, i);
+    }
+
+    bool ok = true;
+    size_t n = 0;
+    while (ok && keys[tree[0]] != EXHAUSTED)
+    {
+        int w = tree[0];
+        out[n++] = keys[w];
+        if (n == MERGE_OUT)
+        {
+            ok = sink(out, n, state);
+            n = 0;
+        }
+
+        run *r = &m->runs[w];
+        if (++r->pos == r->len[r->current] && !next_buffer(m, w))
+        {
+            ok = false;
+        }
+        keys[w] = head_key(r);
+        adjust(tree, keys, k, w);
+    }
+    if (ok && n > 0)
+    {
+        ok = sink(out, n, state);
+    }
+
+    free(keys);
+    free(tree);
+    free(out);
+    return ok;
+}
+
+/**
+ * Sink appending merged values to a spill.
+ */
+static bool spill_sink(const int *values, size_t n, void *state)
+{
+    spill *s = state;
+    s->size += n * sizeof(int);
+    return write_all(s->fd, values, n * sizeof(int));
+}
+
+/**
+ * Sink appending merged values to the index.
+ */
+static bool index_sink(const int *values, size_t n, void *state)
+{
+    return sortindex_append(state, values, n);
+}
+
+/**
+ * Merges count spills into sink through buffers of buf_values each,
+ * closing them.
+ */
+static bool merge_spills(spill spills[], int count, size_t buf_values,
+    merge_sink sink, void *state)
+{
+    merger m;
+    bool ok = open_merger(&m, spills, count, buf_values);
+    if (ok)
+    {
+        ok = merge(&m, sink, state);
+        close_merger(&m);
+    }
+
+    int saved = errno;
+    for (int i = 0; i < count; i++)
+    {
+        close(spills[i].fd);
+    }
+    errno = saved;
+    return ok;
+}
+
+/**
+ * Cuts the input into sorted runs of up to run_values each, writing
+ * them to spills in tmp_dir. If it all fits in one run, it goes straight
+ * to the index instead and *spills is left NULL.
+ */
+static bool make_runs(int in, size_t run_values, const char *tmp_dir,
+    sortindex_writer *w, spill **spills, int *count)
+{
+    *spills = NULL;
+    *count = 0;
+    int cap = 0;
+
+    int *buf = malloc(run_values * sizeof(int));
+    if (buf == NULL)
+    {
+        return false;
+    }
+
+    bool ok = true;
+    while (ok)
+    {
+        ssize_t n = read_full(in, buf, run_values * sizeof(int), NULL);
+        if (n < 0 || n % sizeof(int) != 0)
+        {
+            errno = n < 0 ? errno : EINVAL;
+            ok = false;
+            break;
+        }
+        size_t values = n / sizeof(int);
+        bool last = values < run_values;
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        for (size_t i = 0; i < values; i++)
+        {
+            buf[i] = __builtin_bswap32(buf[i]);
+        }
+#endif
+        sort(buf, values);
+
+        // nothing to merge with
+        if (last && *count == 0)
+        {
+            ok = sortindex_append(w, buf, values);
+            break;
+        }
+        if (values == 0)
+        {
+            break;
+        }
+
+        if (*count == cap)
+        {
+            cap = cap ? cap * 2 : 64;
+            spill *grown = realloc(*spills, cap * sizeof(spill));
+            if (grown == NULL)
+            {
+                ok = false;
+                break;
+            }
+            *spills = grown;
+        }
+        spill *s = &(*spills)[*count];
+        s->fd = create_spill(tmp_dir);
+        s->size = n;
+        ok = s->fd >= 0;
+        if (ok)
+        {
+            (*count)++;
+            ok = write_all(s->fd, buf, n);
+        }
+        if (last)
+        {
+            break;
+        }
+    }
+
+    int saved = errno;
+    free(buf);
+    if (!ok)
+    {
+        for (int i = 0; i < *count; i++)
+        {
+            close((*spills)[i].fd);
+        }
+        free(*spills);
+        *spills = NULL;
+        *count = 0;
+    }
+    errno = saved;
+    return ok;
+}
+
+/**
+ * Merges count spills into the index within budget, taking and closing
+ * them. The oldest runs are merged into new ones at the back of the list
+ * until few enough are left for one pass.
+ */
+static bool merge_runs(spill *spills, int count, size_t budget,
+    const char *tmp_dir, sortindex_writer *w)
+{
+    // what merging may use, after the output buffers and the fences the
+    // index keeps in memory until it is finished
+    off_t total = 0;
+    for (int i = 0; i < count; i++)
+    {
+        total += spills[i].size;
+    }
+    size_t fences = total / sizeof(int) / SORTINDEX_STRIDE * sizeof(int) * 2;
+    size_t reserved = fences + OUTBUF_SIZE + MERGE_OUT * sizeof(int)
+        + PROCESS_RESERVE;
+    size_t room = budget > reserved ? budget - reserved : 0;
+    size_t most = room / (2 * MIN_RUN_BUFFER);
+    int fan_in = most < (size_t) count ? (int) most : count;
+
+    bool ok = fan_in >= 2 || count == 1;
+    if (!ok)
+    {
+        errno = ENOMEM;
+    }
+
+    int first = 0;
+    while (ok && count - first > fan_in)
+    {
+        spill *grown = realloc(spills, (count + 1) * sizeof(spill));
+        spill merged = {grown ? create_spill(tmp_dir) : -1, 0};
+        if (grown != NULL)
+        {
+            spills = grown;
+        }
+        if (merged.fd < 0)
+        {
+            ok = false;
+            break;
+        }
+
+        ok = merge_spills(spills + first, fan_in,
+            room / (2 * fan_in * sizeof(int)), spill_sink, &merged);
+        first += fan_in;
+        spills[count++] = merged;
+    }
+
+    if (ok)
+    {
+        int k = count - first;
+        ok = merge_spills(spills + first, k, room / (2 * k * sizeof(int)),
+            index_sink, w);
+    }
+    else
+    {
+        int saved = errno;
+        for (int i = first; i < count; i++)
+        {
+            close(spills[i].fd);
+        }
+        errno = saved;
+    }
+    free(spills);
+    return ok;
+}
+
+bool extsort(const char *in_path, const char *out_path, size_t budget,
+    const char *tmp_dir)
+{
+    if (budget < EXTSORT_MIN_BUDGET)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    int in = strcmp(in_path, "-") == 0 ? STDIN_FILENO : open(in_path, O_RDONLY);
+    if (in < 0)
+    {
+        return false;
+    }
+    posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    sortindex_writer w;
+    if (!sortindex_begin(&w, out_path, SORTINDEX_STRIDE))
+    {
+        int saved = errno;
+        if (in != STDIN_FILENO)
+        {
+            close(in);
+        }
+        errno = saved;
+        return false;
+    }
+
+    // a run and sort's scratch copy of it share the budget, less what
+    // the index's own buffer and the process take
+    size_t run_values = (budget - OUTBUF_SIZE - PROCESS_RESERVE) / 2
+        / sizeof(int);
+    if (run_values > INT_MAX)
+    {
+        run_values = INT_MAX;
+    }
+
+    spill *spills;
+    int count;
+    bool ok = make_runs(in, run_values, tmp_dir, &w, &spills, &count);
+    int saved = errno;
+    if (in != STDIN_FILENO)
+    {
+        close(in);
+    }
+    errno = saved;
+
+    // sort's scratch space can be left on the heap once malloc has
+    // raised its mmap threshold past it, hand it back before merging
+    malloc_trim(0);
+
+    if (ok && count > 0)
+    {
+        ok = merge_runs(spills, count, budget, tmp_dir, &w);
+    }
+
+    if (!ok)
+    {
+        sortindex_abort(&w);
+        return false;
+    }
+    return sortindex_finish(&w);
+}
@@ -0,0 +1,32 @@
+/**
+ * extsort.h
+ *
+ * External merge sort, for haystacks too big to sort in memory.
+ */
+
+#ifndef EXTSORT_H
+#define EXTSORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// smallest memory budget extsort accepts
+#define EXTSORT_MIN_BUDGET (16 << 20)
+
+/**
+ * Sorts a file of raw little-endian 32 bit ints into a sortindex at
+ * out_path, using no more than about budget bytes of memory. Sorted runs
+ * are spilled to unlinked temporary files in tmp_dir, then merged.
+ *
+ * @param const char* in_path The values, "-" meaning stdin
+ * @param const char* out_path The index to write
+ * @param size_t budget Bytes of memory to stay within
+ * @param const char* tmp_dir Where to spill sorted runs
+ *
+ * @return bool false with errno set on failure, EINVAL if the budget is
+ *         below EXTSORT_MIN_BUDGET or the input is not whole ints
+ */
+bool extsort(const char *in_path, const char *out_path, size_t budget,
+    const char *tmp_dir);
+
+#endif
@@ -0,0 +1,129 @@
+/**
+ * eytzinger.c
+ *
+ * Sorted values laid out in Eytzinger (breadth-first) order.
+ *
+ * Searches descend branch free, k = 2k + (tree[k] < value), until they
+ * fall off the bottom; the trailing ones of k then count the right turns
+ * since the last left one, and shifting them off gives the lower bound.
+ * The tree is 64 byte aligned with index 0 unused, so the 16
+ * descendants four levels below k share the cache line at 16k, which is
+ * prefetched on the way down.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "eytzinger.h"
+
+// size of a cache line
+#define CACHE_LINE 64
+
+// needles searched together in a batch
+#define BATCH 16
+
+/**
+ * Copies sorted values into tree in in-order position, returning the
+ * index of the next sorted value.
+ */
+static size_t fill(const int sorted[], int *tree, size_t i, size_t k,
+    size_t n)
+{
+    if (k <= n)
+    {
+        i = fill(sorted, tree, i, 2 * k, n);
+        tree[k] = sorted[i++];
+        i = fill(sorted, tree, i, 2 * k + 1, n);
+    }
+    return i;
+}
+
+int *eytzinger_build(const int sorted[], size_t n)
+{
+    size_t bytes = (n + 1) * sizeof(int);
+    bytes = (bytes + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+
+    int *tree;
+    if (posix_memalign((void **) &tree, CACHE_LINE, bytes) != 0)
+    {
+        return NULL;
+    }
+    tree[0] = 0;
+    fill(sorted, tree, 0, 1, n);
+    return tree;
+}
+
+void eytzinger_free(int *tree)
+{
+    free(tree);
+}
+
+/**
+ * Turns the index a search fell off the tree at into its lower bound,
+ * 0 if every value was smaller.
+ */
+static inline size_t lower_bound(size_t k)
+{
+    return k >> __builtin_ffsll(~k);
+}
+
+bool eytzinger_search(const int *tree, size_t n, int value)
+{
+    size_t k = 1;
+    while (k <= n)
+    {
+        __builtin_prefetch(tree + 16 * k);
+        k = 2 * k + (tree[k] < value);
+    }
+    k = lower_bound(k);
+    return k != 0 && tree[k] == value;
+}
+
+void eytzinger_search_batch(const int *tree, size_t n, const int needles[],
+    size_t count, unsigned char *hits)
+{
+    memset(hits, 0, (count + 7) / 8);
+
+    // every search takes one step per level
+    int levels = 0;
+    while (((size_t) 1 << levels) <= n)
+    {
+        levels++;
+    }
+
+    for (size_t start = 0; start < count; start += BATCH)
+    {
+        size_t batch = count - start < BATCH ? count - start : BATCH;
+        const int *x = needles + start;
+        size_t k[BATCH];
+        for (size_t j = 0; j < batch; j++)
+        {
+            k[j] = 1;
+        }
+
+        // one level for every needle in turn, so their loads overlap
+        for (int level = 0; level < levels; level++)
+        {
+            for (size_t j = 0; j < batch; j++)
+            {
+                if (k[j] <= n)
+                {
+                    k[j] = 2 * k[j] + (tree[k[j]] < x[j]);
+                    __builtin_prefetch(tree + 16 * k[j]);
+                }
+            }
+        }
+
+        for (size_t j = 0; j < batch; j++)
+        {
+            size_t found = lower_bound(k[j]);
+            if (found != 0 && tree[found] == x[j])
+            {
+                hits[(start + j) / 8] |= 1 << ((start + j) % 8);
+            }
+        }
+    }
+}
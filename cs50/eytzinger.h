@@ -0,0 +1,63 @@
+/**
+ * eytzinger.h
+ *
+ * Sorted values laid out in Eytzinger (breadth-first) order, for
+ * answering many membership queries against one haystack.
+ */
+
+#ifndef EYTZINGER_H
+#define EYTZINGER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Lays n sorted values out as an implicit binary search tree, root at
+ * index 1 and the children of k at 2k and 2k + 1, so that the first
+ * levels of every search share a few cache lines.
+ *
+ * @param const int* sorted The values, in ascending order
+ * @param size_t n The number of values
+ *
+ * @return int* The tree, to be freed with eytzinger_free, or NULL
+ */
+int *eytzinger_build(const int sorted[], size_t n);
+
+/**
+ * Frees a tree from eytzinger_build.
+ *
+ * @param int* tree The tree
+ *
+ * @return void
+ */
+void eytzinger_free(int *tree);
+
+/**
+ * Returns true if value is in the tree of n values, else false.
+ *
+ * @param const int* tree The tree
+ * @param size_t n The number of values
+ * @param int value The value to look for
+ *
+ * @return bool Whether it was found
+ */
+bool eytzinger_search(const int *tree, size_t n, int value);
+
+/**
+ * Looks up count needles at once, setting bit i of hits (least
+ * significant bit first) if needles[i] is in the tree and clearing it if
+ * not. Needles are searched in interleaved groups, so the memory
+ * accesses of one needle overlap those of the others.
+ *
+ * @param const int* tree The tree
+ * @param size_t n The number of values
+ * @param const int* needles The values to look for
+ * @param size_t count The number of needles
+ * @param unsigned char* hits Room for (count + 7) / 8 bytes
+ *
+ * @return void
+ */
+void eytzinger_search_batch(const int *tree, size_t n, const int needles[],
+    size_t count, unsigned char *hits);
+
+#endif
@@ -6,10 +6,26 @@
  *
  * Implements the Game of Fifteen (generalized to d x d).
  *
- * Usage: ./fifteen d
+ * Usage: ./fifteen d [--board BOARD]
+ *                  [--log FILE] [--log-flush N] [--log-sync WHEN]
+ *                  [--solve|--hint [--table FILE]]                 d = 3
+ *                  [--solve|--hint [--pdb FILE] [--threads N]]     d > 3
  *
  * whereby the board's dimensions are to be d x d,
- * where d must be in [MIN,MAX]
+ * where d must be in [MIN,MAX]. --board starts from BOARD, written as
+ * save() logs boards, e.g. {{8,7,6},{5,4,3},{2,1,95}}, instead of the
+ * usual start. Every turn is logged, as one byte, to the binary move
+ * log FILE, by default LOG, which ./replay turns back into boards. The
+ * log is written out every N turns, by default every turn when playing
+ * at a terminal and only when its buffer fills otherwise, and synced to
+ * disk as WHEN says: never, after every checkpoint, or after every
+ * flush. --solve prints a shortest sequence of tiles to move from
+ * the start to the win instead of playing, estimating with the pattern
+ * databases in FILE, built by pdbgen, if given, and searching on N
+ * threads, by default 1. --hint prints just the first tile to move.
+ * 3 x 3 boards are not searched but looked up in the complete table in
+ * --table FILE, by default TABLE, which is built there if missing, so
+ * --pdb and --threads are for bigger boards only, and --table for 3 x 3.
  *
  * Note that usleep is obsolete, but it offers more granularity than
  * sleep and is simpler to use than nanosleep; `man usleep` for more.
@@ -18,16 +34,34 @@
 #define _XOPEN_SOURCE 500
 
 #include <cs50.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "complete.h"
+#include "movelog.h"
+#include "pdb.h"
+#include "solver.h"
+
 // board's minimal dimension
 #define MIN 3
 
 // board's maximal dimension
 #define MAX 9
 
+// value of the blank tile, an underscore when printed
+#define BLANK 95
+
+// default complete table of MIN x MIN boards
+#define TABLE "fifteen3.table"
+
+// default move log
+#define LOG "log.bin"
+
 // board, whereby board[i][j] represents row i and column j
 int board[MAX][MAX];
 
@@ -35,27 +69,112 @@ int board[MAX][MAX];
 int d;
 
 // Current position of blank tile
-int blank_column;
 int blank_row;
+int blank_column;
+
+// Current position of every tile, tile_row[t] and tile_column[t] of tile t
+int tile_row[MAX * MAX];
+int tile_column[MAX * MAX];
+
+// Number of tiles not where they are when the game is won
+int misplaced;
+
+// Move log, while logging
+movelog_writer log_writer;
+bool logging = false;
 
 // prototypes
 void clear(void);
 void greet(void);
 void init(void);
+bool load_board(string text);
+void index_board(void);
 void draw(void);
 bool move(int tile);
 bool won(void);
-void save(void);
+bool open_log(string path, movelog_policy *policy);
+void save(int tile);
+void close_log(void);
+int solve_board(string databases, int threads, string table, bool hint);
 
 int main(int argc, string argv[])
 {
-    // greet player
-    greet();
-
     // ensure proper usage
-    if (argc != 2)
+    string start = NULL;
+    string databases = NULL;
+    string table = NULL;
+    int threads = 0;
+    bool solving = false;
+    bool hint = false;
+    string log = NULL;
+    movelog_policy policy = {MOVELOG_CHECKPOINT_EVERY,
+        isatty(STDIN_FILENO) ? 1 : 0, MOVELOG_SYNC_NEVER};
+    bool log_options = false;
+    bool usage = argc >= 2;
+    for (int i = 2; i < argc && usage; i++)
     {
-        printf("Usage: ./fifteen d\n");
+        if (strcmp(argv[i], "--board") == 0 && i + 1 < argc)
+        {
+            start = argv[++i];
+        }
+        else if (strcmp(argv[i], "--solve") == 0)
+        {
+            solving = true;
+        }
+        else if (strcmp(argv[i], "--hint") == 0)
+        {
+            hint = true;
+        }
+        else if (strcmp(argv[i], "--table") == 0 && i + 1 < argc)
+        {
+            table = argv[++i];
+        }
+        else if (strcmp(argv[i], "--pdb") == 0 && i + 1 < argc)
+        {
+            databases = argv[++i];
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+            usage = threads >= 1;
+        }
+        else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc)
+        {
+            log = argv[++i];
+            log_options = true;
+        }
+        else if (strcmp(argv[i], "--log-flush") == 0 && i + 1 < argc)
+        {
+            policy.flush_every = atoi(argv[++i]);
+            log_options = true;
+        }
+        else if (strcmp(argv[i], "--log-sync") == 0 && i + 1 < argc)
+        {
+            i++;
+            policy.sync = strcmp(argv[i], "never") == 0 ? MOVELOG_SYNC_NEVER
+                : strcmp(argv[i], "checkpoint") == 0 ? MOVELOG_SYNC_CHECKPOINT
+                : strcmp(argv[i], "flush") == 0 ? MOVELOG_SYNC_FLUSH : -1;
+            usage = policy.sync >= 0;
+            log_options = true;
+        }
+        else
+        {
+            usage = false;
+        }
+    }
+    // 3 x 3 boards are looked up in the table, bigger ones searched
+    bool searching = solving || hint;
+    bool searched = databases != NULL || threads != 0;
+    if (!usage || (solving && hint) || (log_options && searching)
+        || ((searched || table != NULL) && !searching)
+        || (atoi(argv[1]) == COMPLETE_D ? searched : table != NULL))
+    {
+        printf("Usage: ./fifteen d [--board BOARD] "
+            "[--log FILE] [--log-flush N] [--log-sync never|checkpoint|flush]\n"
+            "                  "
+            "[--solve|--hint [--table FILE]]                 d = 3\n"
+            "                  "
+            "[--solve|--hint [--pdb FILE] [--threads N]]     d > 3\n");
         return 1;
     }
 
@@ -70,6 +189,29 @@ int main(int argc, string argv[])
 
     // initialize the board
     init();
+    if (start != NULL && !load_board(start))
+    {
+        printf("Board must hold tiles 1 through %i and one blank.\n",
+            d * d - 1);
+        return 3;
+    }
+
+    // solve instead of playing
+    if (searching)
+    {
+        return solve_board(databases, threads,
+            table != NULL ? table : TABLE, hint);
+    }
+
+    // log the game (for testing)
+    if (!open_log(log != NULL ? log : LOG, &policy))
+    {
+        printf("Error! %s\n", strerror(errno));
+        return 7;
+    }
+
+    // greet player
+    greet();
 
     // accept moves until game is won
     while (true)
@@ -80,9 +222,6 @@ int main(int argc, string argv[])
         // draw the current state of the board
         draw();
 
-        // saves the current state of the board (for testing)
-        save();
-
         // check for win
         if (won())
         {
@@ -94,6 +233,12 @@ int main(int argc, string argv[])
         printf("Tile to move: ");
         int tile = GetInt();
 
+        // stop at the end of input
+        if (tile == INT_MAX)
+        {
+            break;
+        }
+
         // move if possible, else report illegality
         if (!move(tile))
         {
@@ -101,11 +246,15 @@ int main(int argc, string argv[])
             usleep(500000);
         }
 
+        // saves the turn (for testing)
+        save(tile);
+
         // sleep for animation's sake
         usleep(500000);
     }
 
     // that's all folks
+    close_log();
     return 0;
 }
 
@@ -152,7 +301,7 @@ void init(void)
 			else
 			{
 				// Set blank tile to a underscore, not a number
-				board[i][j] = 95;
+				board[i][j] = BLANK;
 			}
 		}
 	}
@@ -163,6 +312,81 @@ void init(void)
 		board[d - 1][d - 2] = 2;
 		board[d - 1][d - 3] = 1;
 	}
+
+	index_board();
+}
+
+/**
+ * Replaces the board with one written as save() logs them, returning
+ * false if text is not a d x d board of tiles 1 through d*d - 1 and a
+ * blank, written BLANK or 0.
+ */
+bool load_board(string text)
+{
+	int values[MAX * MAX];
+	int count = 0;
+	for (char *p = text; *p != '\0'; )
+	{
+		if (*p == '{' || *p == '}' || *p == ',' || *p == ' ')
+		{
+			p++;
+			continue;
+		}
+		char *end;
+		long value = strtol(p, &end, 10);
+		if (end == p || count == d * d)
+		{
+			return false;
+		}
+		values[count++] = value == 0 ? BLANK : value;
+		p = end;
+	}
+	if (count != d * d)
+	{
+		return false;
+	}
+
+    // Check before replacing, so a bad board leaves the start alone
+	int loaded[MAX][MAX];
+	for (int i = 0; i < count; i++)
+	{
+		loaded[i / d][i % d] = values[i];
+	}
+	puzzle p;
+	if (!puzzle_from_board(&p, d, loaded, BLANK))
+	{
+		return false;
+	}
+
+	memcpy(board, loaded, sizeof(loaded));
+	index_board();
+	return true;
+}
+
+/**
+ * Finds where every tile and the blank are and counts the misplaced
+ * tiles, which move() then keeps up to date.
+ */
+void index_board(void)
+{
+	misplaced = 0;
+	for (int i = 0; i < d; i++)
+	{
+		for (int j = 0; j < d; j++)
+		{
+			if (board[i][j] == BLANK)
+			{
+				blank_row = i;
+				blank_column = j;
+			}
+			else
+			{
+				tile_row[board[i][j]] = i;
+				tile_column[board[i][j]] = j;
+				misplaced += board[i][j] != i * d + j + 1;
+			}
+		}
+	}
 }
 
 /**
@@ -177,12 +401,8 @@ void draw(void)
 		for (int j = 0; j < d; j++)
 		{
 		    // If the current tile is the blank tile
-			if (board[i][j] == 95)
+			if (board[i][j] == BLANK)
 			{
-			    // Set the current position of the blank tile
-			    blank_column = i;
-				blank_row = j;
-				
 			    // Don't print leading space before underscore on blank tile
 				if (d < 4)
 				{
@@ -216,34 +436,36 @@ void draw(void)
  */
 bool move(int tile)
 {
-    // To hold the current position of tile
-    int move_column, move_row;
-
-    // Get the current position of tile
-	for (int i = 0; i < d; i++)
+    // Only tiles on the board can move
+	if (tile < 1 || tile >= d * d)
 	{
-		for (int j = 0; j < d; j++)
-		{
-			if (board[i][j] == tile)
-			{
-				move_column = i; // Current column of tile
-				move_row = j;    // Current row of tile
-			}
-		}
-
+		return false;
 	}
 
+    // Look up the current position of tile
+	int row = tile_row[tile];
+	int column = tile_column[tile];
+
     // Check to see if the requested move is legal
-	if ( ( move_column == blank_column && ( move_row == blank_row + 1 || move_row == blank_row - 1 ) ) || ( move_row == blank_row && ( move_column == blank_column + 1 || move_column == blank_column - 1 ) ) )
+	if (abs(row - blank_row) + abs(column - blank_column) != 1)
 	{
-	    // Swap the tiles
-		board[move_column][move_row] = 95;
-		board[blank_column][blank_row] = tile;
-
-		return true;
+		return false;
 	}
 
-	return false;
+    // Only the moving tile can become placed or misplaced
+	int goal = tile - 1;
+	misplaced -= row * d + column != goal;
+	misplaced += blank_row * d + blank_column != goal;
+
+    // Swap the tiles
+	board[blank_row][blank_column] = tile;
+	board[row][column] = BLANK;
+	tile_row[tile] = blank_row;
+	tile_column[tile] = blank_column;
+	blank_row = row;
+	blank_column = column;
+
+	return true;
 }
 
 /**
@@ -252,85 +474,165 @@ bool move(int tile)
  */
 bool won(void)
 {
-    int start_tile = 1; // Starting number of the top left tile
-	bool won = false;   // Game over?
-	int true_count = 0; // Keep count of correct tiles
-	int last_tile;      // Current value of the last tile bottom right
-
-    // Check to see if all the tiles are in winning order
-	for (int i = 0; i < d; i++)
-	{
-		for (int j = 0; j < d; j++)
-		{
-			if (board[i][j] == start_tile)
-			{
-			    // Add one to true_count if the tile value matches win value
-				true_count++;
-			}
+    // With every tile in place, the blank can only be bottom right
+	return misplaced == 0;
+}
 
-            // Find the value of the last tile bottom right
-			if (i == d - 1 && j == d - 1)
-			{
-				last_tile = board[i][j];
-			}
+/**
+ * Starts the move log at path with the board as it is, returning false
+ * if it cannot be created.
+ */
+bool open_log(string path, movelog_policy *policy)
+{
+	puzzle p;
+	puzzle_from_board(&p, d, board, BLANK);
+	logging = movelog_begin(&log_writer, path, &p, policy);
+	return logging;
+}
 
-			start_tile++;
-		}
+/**
+ * Saves a turn, the tile asked for, to the move log (for testing), and
+ * the whole board every so many turns. Stops logging if it fails.
+ */
+void save(int tile)
+{
+	if (!logging)
+	{
+		return;
 	}
-
-    // If all the tiles match you have won, return true
-	if (true_count == d * d - 1 && last_tile == 95)
+	logging = movelog_turn(&log_writer, tile);
+	if (logging && movelog_checkpoint_due(&log_writer))
 	{
-		won = true;
-	}	
+		puzzle p;
+		puzzle_from_board(&p, d, board, BLANK);
+		logging = movelog_checkpoint(&log_writer, &p);
+	}
+}
 
-	return won;
+/**
+ * Writes out and closes the move log.
+ */
+void close_log(void)
+{
+	movelog_end(&log_writer);
+	logging = false;
 }
 
 /**
- * Saves the current state of the board to disk (for testing).
+ * Prints a shortest sequence of tiles to move from the board to the
+ * win, or with hint just the first, and what finding it took, checking
+ * it by playing it through move(). MIN x MIN boards are walked down the
+ * complete table in the file table. Others are searched, estimating
+ * with the pattern databases in the file databases unless NULL, on
+ * threads threads. Returns main's exit status.
  */
-void save(void)
+int solve_board(string databases, int threads, string table, bool hint)
 {
-    // log
-    const string log = "log.txt";
+	puzzle p;
+	puzzle_from_board(&p, d, board, BLANK);
+	if (!puzzle_solvable(&p))
+	{
+		printf("Board cannot be solved.\n");
+		return 4;
+	}
 
-    // delete existing log, if any, before first save
-    static bool saved = false;
-    if (!saved)
-    {
-        unlink(log);
-        saved = true;
-    }
+	uint8_t moves[SOLVE_MAX_MOVES];
+	solve_stats stats = {0, 0};
+	int length;
+	if (d == COMPLETE_D)
+	{
+		complete_table complete;
+		if (!complete_load(&complete, table))
+		{
+			printf("Error! %s\n", strerror(errno));
+			return 7;
+		}
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (hint)
+		{
+			int tile = complete_hint(&complete, &p);
+			moves[0] = tile;
+			length = tile < 0 ? -1 : tile > 0;
+		}
+		else
+		{
+			length = complete_solve(&complete, &p, moves);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		stats.seconds = end.tv_sec - start.tv_sec
+			+ (end.tv_nsec - start.tv_nsec) / 1e9;
+		complete_free(&complete);
 
-    // open log
-    FILE* p = fopen(log, "a");
-    if (p == NULL)
-    {
-        return;
-    }
+		// every solvable board is in a sound table
+		if (length < 0)
+		{
+			printf("Table %s is corrupt.\n", table);
+			return 7;
+		}
+	}
+	else
+	{
+		pdb db;
+		if (databases != NULL)
+		{
+			if (!pdb_open(&db, databases))
+			{
+				printf("Error! %s\n", strerror(errno));
+				return 7;
+			}
+			if (db.d != d)
+			{
+				printf("Pattern databases are for %i x %i boards.\n",
+					db.d, db.d);
+				pdb_free(&db);
+				return 7;
+			}
+		}
+		length = solve_parallel(&p, databases != NULL ? &db : NULL,
+			threads, moves, &stats);
+		if (databases != NULL)
+		{
+			pdb_free(&db);
+		}
+	}
+	if (length < 0)
+	{
+		printf("No solution within %i moves.\n", SOLVE_MAX_MOVES);
+		return 5;
+	}
+	if (hint)
+	{
+		length = length > 0 ? 1 : 0;
+	}
 
-    // log board
-    fprintf(p, "{");
-    for (int i = 0; i < d; i++)
-    {
-        fprintf(p, "{");
-        for (int j = 0; j < d; j++)
-        {
-            fprintf(p, "%i", board[i][j]);
-            if (j < d - 1)
-            {
-                fprintf(p, ",");
-            }
-        }
-        fprintf(p, "}");
-        if (i < d - 1)
-        {
-            fprintf(p, ",");
-        }
-    }
-    fprintf(p, "}\n");
+    // Play the solution through the game itself
+	for (int i = 0; i < length; i++)
+	{
+		printf("%i%s", moves[i], i < length - 1 ? " " : "");
+		if (!move(moves[i]))
+		{
+			printf("\nIllegal move.\n");
+			return 6;
+		}
+	}
+	printf("\n");
+	if (!hint && !won())
+	{
+		printf("Solution does not win.\n");
+		return 6;
+	}
 
-    // close log
-    fclose(p);
+	if (d == COMPLETE_D)
+	{
+		fprintf(stderr, "%i moves from the table in %.1f us\n",
+			length, stats.seconds * 1e6);
+	}
+	else
+	{
+		fprintf(stderr, "%i moves, %llu nodes in %.3f s, %.0f nodes/s\n",
+			length, stats.nodes, stats.seconds,
+			stats.seconds > 0 ? stats.nodes / stats.seconds : 0);
+	}
+	return 0;
 }
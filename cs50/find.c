@@ -7,35 +7,312 @@
  * Prompts user for as many as MAX values until EOF is reached, 
  * then proceeds to search that "haystack" of values for given needle.
  *
- * Usage: ./find needle
+ * Usage: ./find [--haystack FILE [--raw]] needle
+ *        ./find --haystack FILE [--raw] --needles FILE [--raw-needles]
+ *               [--bitmap] [--bloom RATE]
+ *        ./find --haystack FILE [--raw] --build-index INDEX
+ *        ./find --haystack FILE --raw --build-index INDEX --memory MB
+ *               [--tmpdir DIR]
+ *        ./find --index INDEX [--verify] needle
+ *        ./find --index INDEX [--verify] --needles FILE [--raw-needles]
+ *               [--bitmap] [--bloom RATE]
  *
- * where needle is the value to find in a haystack of values
+ * where needle is the value to find in a haystack of values, and FILE,
+ * if given, holds the haystack instead: decimal ints separated by
+ * whitespace, or with --raw, little-endian 32 bit ints. With --needles,
+ * every value in that file is looked up and reported on a line of its
+ * own, or with --bitmap as one bit per needle, least significant first.
+ * --build-index sorts the haystack once and saves it to INDEX, which
+ * --index then maps in place of a haystack, so nothing is sorted at
+ * startup; --verify checks its checksum first. With --memory, the
+ * haystack is sorted out of core in at most about MB megabytes, for
+ * haystacks bigger than memory, spilling to DIR or else next to INDEX.
+ *
+ * With too few needles to pay for sorting the haystack, it is scanned
+ * for each needle instead; where that pays off is measured on the first
+ * run and kept under $XDG_CACHE_HOME or $HOME/.cache for later ones.
+ * --bloom builds a Bloom filter of the haystack with false positive rate
+ * RATE, e.g. 0.01, to turn away most missing needles before they are
+ * searched for, and reports its cost on stderr.
  */
        
 #include <cs50.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
+#include "bloom.h"
+#include "extsort.h"
+#include "eytzinger.h"
+#include "haystack.h"
 #include "helpers.h"
+#include "outbuf.h"
+#include "scan.h"
+#include "sortindex.h"
 
-// maximum amount of hay
+// maximum amount of hay when prompting
 const int MAX = 65536;
 
+// prototypes
+int prompt_haystack(int haystack[]);
+bool find_all(const int values[], size_t size, bool sorted,
+    const haystack *needles, bool bitmap, double fp_rate);
+bool prefilter(const int values[], size_t size, const haystack *needles,
+    double fp_rate, int **kept, size_t **where, size_t *count);
+double now(void);
+
 int main(int argc, string argv[])
 {
+    string haystack_path = NULL;  // --haystack FILE
+    bool raw = false;             // --raw, FILE is binary
+    string needles_path = NULL;   // --needles FILE
+    bool raw_needles = false;     // --raw-needles, needles FILE is binary
+    bool bitmap = false;          // --bitmap, report needles as bits
+    string build_path = NULL;     // --build-index INDEX
+    string index_path = NULL;     // --index INDEX
+    bool verify = false;          // --verify, check INDEX's checksum
+    int memory = 0;               // --memory MB, sort out of core
+    string tmp_dir = NULL;        // --tmpdir DIR, where runs spill
+    double fp_rate = 0;           // --bloom RATE, filter needles first
+    string needle_arg = NULL;
+
+    // parse command-line args
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--haystack") == 0 && i + 1 < argc)
+        {
+            haystack_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--raw") == 0)
+        {
+            raw = true;
+        }
+        else if (strcmp(argv[i], "--needles") == 0 && i + 1 < argc)
+        {
+            needles_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--raw-needles") == 0)
+        {
+            raw_needles = true;
+        }
+        else if (strcmp(argv[i], "--bitmap") == 0)
+        {
+            bitmap = true;
+        }
+        else if (strcmp(argv[i], "--build-index") == 0 && i + 1 < argc)
+        {
+            build_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--index") == 0 && i + 1 < argc)
+        {
+            index_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--verify") == 0)
+        {
+            verify = true;
+        }
+        else if (strcmp(argv[i], "--memory") == 0 && i + 1 < argc)
+        {
+            memory = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--tmpdir") == 0 && i + 1 < argc)
+        {
+            tmp_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--bloom") == 0 && i + 1 < argc)
+        {
+            fp_rate = atof(argv[++i]);
+            if (!(fp_rate > 0 && fp_rate < 1))
+            {
+                needle_arg = NULL;
+                needles_path = NULL;
+                break;
+            }
+        }
+        else if (needle_arg == NULL)
+        {
+            needle_arg = argv[i];
+        }
+        else
+        {
+            needle_arg = NULL;
+            needles_path = NULL;
+            break;
+        }
+    }
+
     // ensure proper usage
-    if (argc != 2)
+    bool batch = needles_path != NULL;
+    bool building = build_path != NULL;
+    bool indexed = index_path != NULL;
+    bool valid = building
+        ? haystack_path != NULL && needle_arg == NULL && !batch && !indexed
+            && !verify && !raw_needles && !bitmap
+            && (memory == 0 || (raw && memory > 0))
+            && (tmp_dir == NULL || memory != 0) && fp_rate == 0
+        : (needle_arg == NULL) == batch && (haystack_path != NULL || !raw)
+            && (haystack_path != NULL) + indexed <= 1 && (indexed || !verify)
+            && (!batch || haystack_path != NULL || indexed)
+            && (batch || (!raw_needles && !bitmap && fp_rate == 0))
+            && memory == 0 && tmp_dir == NULL;
+    if (!valid)
     {
-        printf("Usage: ./find needle\n");
+        printf("Usage: ./find [--haystack FILE [--raw]] needle\n");
+        printf("       ./find --haystack FILE [--raw] --needles FILE "
+            "[--raw-needles] [--bitmap] [--bloom RATE]\n");
+        printf("       ./find --haystack FILE [--raw] --build-index INDEX\n");
+        printf("       ./find --haystack FILE --raw --build-index INDEX "
+            "--memory MB [--tmpdir DIR]\n");
+        printf("       ./find --index INDEX [--verify] needle\n");
+        printf("       ./find --index INDEX [--verify] --needles FILE "
+            "[--raw-needles] [--bitmap] [--bloom RATE]\n");
         return -1;
     }
 
     // remember needle
-    int needle = atoi(argv[1]);
+    int needle = needle_arg == NULL ? 0 : atoi(needle_arg);
+
+    // sort a haystack too big for memory straight into an index
+    if (building && memory > 0)
+    {
+        char dir[strlen(build_path) + 2];
+        if (tmp_dir == NULL)
+        {
+            strcpy(dir, build_path);
+            char *slash = strrchr(dir, '/');
+            strcpy(slash ? slash + 1 : dir, ".");
+            tmp_dir = dir;
+        }
+        if (!extsort(haystack_path, build_path, (size_t) memory << 20, tmp_dir))
+        {
+            printf("Error! %s: %s\n", build_path, strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+
+    // fill haystack, from an index, a file or the user
+    haystack hay = {NULL, 0, NULL, 0};
+    sortindex index = {NULL, 0, NULL, 0, 0, 0, NULL, 0};
+    int prompted[haystack_path == NULL && !indexed ? MAX : 1];
+    if (indexed)
+    {
+        if (!sortindex_open(&index, index_path, verify))
+        {
+            printf("Error! %s: %s\n", index_path, strerror(errno));
+            return -1;
+        }
+    }
+    else if (haystack_path != NULL)
+    {
+        bool loaded = raw ? haystack_load_raw(&hay, haystack_path)
+            : haystack_load_text(&hay, haystack_path);
+        if (!loaded)
+        {
+            printf("Error! %s: %s\n", haystack_path, strerror(errno));
+            return -1;
+        }
+    }
+    else
+    {
+        hay.size = prompt_haystack(prompted);
+        hay.values = prompted;
+    }
+
+    // load the needles before sorting, how many there are decides it
+    haystack needles = {NULL, 0, NULL, 0};
+    if (batch)
+    {
+        bool ok = raw_needles ? haystack_load_raw(&needles, needles_path)
+            : haystack_load_text(&needles, needles_path);
+        if (!ok)
+        {
+            printf("Error! %s: %s\n", needles_path, strerror(errno));
+            return -1;
+        }
+    }
+
+    // sort the haystack, unless the index already holds it sorted or
+    // scanning it for this few needles is cheaper
+    bool scanning = !indexed && !building
+        && scan_preferred(hay.size, batch ? needles.size : 1);
+    if (!indexed && !scanning)
+    {
+        sort(hay.values, hay.size);
+    }
+    const int *values = indexed ? index.values : hay.values;
+    size_t size = indexed ? index.count : hay.size;
+
+    // save the sorted haystack for later runs
+    if (building)
+    {
+        bool ok = sortindex_write(build_path, values, size);
+        haystack_free(&hay);
+        if (!ok)
+        {
+            printf("Error! %s: %s\n", build_path, strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+
+    // look up every needle in the file
+    if (batch)
+    {
+        bool ok = find_all(values, size, !scanning, &needles, bitmap,
+            fp_rate);
+        haystack_free(&needles);
+        haystack_free(&hay);
+        if (indexed)
+        {
+            sortindex_close(&index);
+        }
+        if (!ok)
+        {
+            printf("Error! %s\n", strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+
+    // try to find needle in haystack
+    bool found;
+    if (indexed)
+    {
+        found = sortindex_search(&index, needle);
+        sortindex_close(&index);
+    }
+    else
+    {
+        found = scanning ? scan_contains(hay.values, size, needle)
+            : search(needle, hay.values, size);
+        if (haystack_path != NULL)
+        {
+            haystack_free(&hay);
+        }
+    }
+
+    if (found)
+    {
+        printf("\nFound needle in haystack!\n\n");
+        return 0;
+    }
+    else
+    {
+        printf("\nDidn't find needle in haystack.\n\n");
+        return 1;
+    }
+}
 
-    // fill haystack
+/**
+ * Prompts for as many as MAX values until EOF is reached, storing them in
+ * haystack. Returns the number of values.
+ */
+int prompt_haystack(int haystack[])
+{
     int size;
-    int haystack[MAX];
     for (size = 0; size < MAX; size++)
     {
         // wait for hay until EOF
@@ -50,19 +327,159 @@ int main(int argc, string argv[])
         haystack[size] = straw;
     }
     printf("\n");
+    return size;
+}
 
-    // sort the haystack
-    sort(haystack, size);
+/**
+ * Looks up every needle in the haystack and writes the results to
+ * stdout. A sorted haystack is searched a batch at a time through an
+ * Eytzinger layout of it, an unsorted one is scanned for each needle.
+ * With fp_rate, only needles a Bloom filter of the haystack lets through
+ * are searched for. Returns false with errno set on failure.
+ */
+bool find_all(const int values[], size_t size, bool sorted,
+    const haystack *needles, bool bitmap, double fp_rate)
+{
+    // the needles to search for, and where each came from if filtered
+    const int *wanted = needles->values;
+    size_t count = needles->size;
+    int *kept = NULL;
+    size_t *where = NULL;
+    if (fp_rate > 0)
+    {
+        if (!prefilter(values, size, needles, fp_rate, &kept, &where, &count))
+        {
+            return false;
+        }
+        wanted = kept;
+    }
 
-    // try to find needle in haystack
-    if (search(needle, haystack, size))
+    int *tree = sorted ? eytzinger_build(values, size) : NULL;
+    unsigned char *hits = calloc((needles->size + 7) / 8 + 1, 1);
+    unsigned char *found = kept ? calloc((count + 7) / 8 + 1, 1) : hits;
+    outbuf out;
+    if ((sorted && tree == NULL) || hits == NULL || found == NULL
+        || !outbuf_open(&out, "-", OUTBUF_SIZE, false))
     {
-        printf("\nFound needle in haystack!\n\n");
-        return 0;
+        eytzinger_free(tree);
+        if (found != hits)
+        {
+            free(found);
+        }
+        free(hits);
+        free(kept);
+        free(where);
+        return false;
+    }
+
+    if (sorted)
+    {
+        eytzinger_search_batch(tree, size, wanted, count, found);
     }
     else
     {
-        printf("\nDidn't find needle in haystack.\n\n");
-        return 1;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (scan_contains(values, size, wanted[i]))
+            {
+                found[i / 8] |= 1 << (i % 8);
+            }
+        }
+    }
+
+    // put filtered results back in the needles' order
+    if (kept != NULL)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (found[i / 8] & (1 << (i % 8)))
+            {
+                hits[where[i] / 8] |= 1 << (where[i] % 8);
+            }
+        }
+        free(found);
+        free(kept);
+        free(where);
+    }
+
+    bool ok = true;
+    if (bitmap)
+    {
+        ok = outbuf_append(&out, (char *) hits, (needles->size + 7) / 8);
+    }
+    else
+    {
+        for (size_t i = 0; ok && i < needles->size; i++)
+        {
+            char line[32];
+            bool hit = hits[i / 8] & (1 << (i % 8));
+            int len = snprintf(line, sizeof(line), "%d %s\n",
+                needles->values[i], hit ? "found" : "missing");
+            ok = outbuf_append(&out, line, len);
+        }
+    }
+
+    ok = outbuf_close(&out) && ok;
+    eytzinger_free(tree);
+    free(hits);
+    return ok;
+}
+
+/**
+ * Builds a Bloom filter of the haystack and keeps the needles it lets
+ * through, in *kept, with their positions among all the needles in
+ * *where and their number in *count. Reports what the filter cost and
+ * how many needles it turned away on stderr. Returns false with errno
+ * set on failure.
+ */
+bool prefilter(const int values[], size_t size, const haystack *needles,
+    double fp_rate, int **kept, size_t **where, size_t *count)
+{
+    double start = now();
+    bloom filter;
+    if (!bloom_init(&filter, size, fp_rate))
+    {
+        return false;
     }
+    bloom_add(&filter, values, size);
+    double built = now();
+
+    *kept = malloc((needles->size + 1) * sizeof(int));
+    *where = malloc((needles->size + 1) * sizeof(size_t));
+    if (*kept == NULL || *where == NULL)
+    {
+        free(*kept);
+        free(*where);
+        bloom_free(&filter);
+        return false;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < needles->size; i++)
+    {
+        (*kept)[n] = needles->values[i];
+        (*where)[n] = i;
+        n += bloom_contains(&filter, needles->values[i]);
+    }
+    *count = n;
+    double filtered = now();
+
+    fprintf(stderr, "bloom: %zu bytes, %.1f bits per value, %d hashes, "
+        "built in %.1f ms\n", bloom_bytes(&filter), filter.bits_per_value,
+        filter.hashes, (built - start) * 1e3);
+    fprintf(stderr, "bloom: %zu of %zu needles passed in %.1f ms\n", n,
+        needles->size, (filtered - built) * 1e3);
+
+    bloom_free(&filter);
+    return true;
+}
+
+/**
+ * Returns the time since some fixed point, in seconds.
+ */
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
 }
@@ -0,0 +1,837 @@
+/**
+ * findd.c
+ *
+ * Long-running find. Loads and sorts a haystack once, then answers
+ * membership queries over a unix domain socket, or with --stdio over
+ * stdin and stdout, so a stream of lookups costs one load, not one per
+ * process.
+ *
+ * The protocol is a line at a time, and clients may send any number of
+ * lines without waiting. Each answer is one line, in order:
+ *
+ *     VALUE          VALUE found | VALUE missing
+ *     reload [FILE]  reloading | error REASON
+ *     stats          stats queries=N hits=N hit_ratio=R ... latency_us=...
+ *
+ * Whatever a client has sent, up to a fair share per wakeup, is read at
+ * once and its queries are looked up as one batch through an Eytzinger
+ * layout of the haystack. A client is not read from again until its
+ * answers have been sent, and keeps no more than a partial line of
+ * input between batches, so none can make the daemon buffer without
+ * bound.
+ *
+ * reload loads FILE, or the haystack given at startup, on a thread of
+ * its own and then publishes it by swapping one atomic pointer, so
+ * lookups carry on against the old haystack meanwhile and never wait.
+ * Lookups only ever run on the main thread, which only picks up a new
+ * haystack between batches; that makes the gap between batches its
+ * quiescent state, after which the old haystack can be freed.
+ *
+ * Usage: ./findd [--raw | --index] [--socket PATH | --stdio] FILE
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "eytzinger.h"
+#include "haystack.h"
+#include "helpers.h"
+#include "sortindex.h"
+
+// socket the daemon listens on unless told otherwise
+#define FINDD_SOCKET "/tmp/findd.sock"
+
+// most clients connected at once
+#define MAX_CLIENTS 1024
+
+// bytes asked for per read, and most read from one client per wakeup
+#define READ_SIZE (256 * 1024)
+#define MAX_READ (4 * READ_SIZE)
+
+// longest line accepted
+#define MAX_LINE 4096
+
+// most input held for a client, a wakeup's read after a partial line
+#define MAX_HELD (MAX_READ + MAX_LINE)
+
+// latency histogram buckets, bucket i counting up to 2^i microseconds
+#define LATENCY_BUCKETS 24
+
+// haystack file formats
+typedef enum
+{
+    TEXT,
+    RAW,
+    INDEX
+}
+format;
+
+// a loaded haystack, as published to the lookups
+typedef struct
+{
+    int *tree;
+    size_t size;
+    unsigned long generation;
+}
+snapshot;
+
+// one connection and its buffered input and output
+typedef struct
+{
+    int in_fd;
+    int out_fd;
+    char *in;
+    size_t in_len;
+    size_t in_cap;
+    char *out;
+    size_t out_len;
+    size_t out_sent;
+    size_t out_cap;
+    bool closing;       // input has ended, close once output is sent
+}
+client;
+
+// lines of a batch waiting to be looked up together
+typedef struct
+{
+    int *needles;
+    size_t count;
+    size_t cap;
+    unsigned char *hits;
+}
+pending;
+
+// counters reported by stats
+typedef struct
+{
+    unsigned long queries;
+    unsigned long hits;
+    unsigned long batches;
+    unsigned long reloads;
+    unsigned long latency[LATENCY_BUCKETS];
+}
+counters;
+
+// the haystack lookups use, swapped in whole by reloads
+_Atomic(snapshot *) current = NULL;
+
+// the snapshot the main thread is using, freed once it moves on
+snapshot *in_use = NULL;
+
+// a reload is running
+atomic_bool reloading = false;
+
+// generation of the last haystack loaded
+atomic_ulong generations = 0;
+
+// why the last reload failed, "" if it did not
+char reload_error[256] = "";
+pthread_mutex_t reload_error_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// the haystack given at startup, and how to read haystacks
+const char *haystack_path;
+format haystack_format = TEXT;
+
+counters stats;
+pending batch;
+
+// set by SIGINT and SIGTERM
+volatile sig_atomic_t stopping = 0;
+
+// prototypes
+snapshot *load_snapshot(const char *path, unsigned long generation);
+void free_snapshot(snapshot *snap);
+void *reload_thread(void *path);
+bool start_reload(const char *path, client *c);
+void pick_up_snapshot(void);
+int listen_on(const char *path);
+void serve(int listener);
+void serve_stdio(void);
+bool handle_input(client *c, bool blocking);
+bool answer_lines(client *c, bool eof);
+bool answer_command(client *c, char *line);
+bool look_up_pending(client *c);
+bool append_output(client *c, const void *data, size_t len);
+bool flush_output(client *c);
+bool keep_client(const client *c);
+void drop_client(client *c);
+double now(void);
+void stop(int signal);
+
+int main(int argc, char *argv[])
+{
+    const char *path = FINDD_SOCKET;
+    bool stdio = false;
+
+    // parse command-line args
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--raw") == 0)
+        {
+            haystack_format = RAW;
+        }
+        else if (strcmp(argv[i], "--index") == 0)
+        {
+            haystack_format = INDEX;
+        }
+        else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc)
+        {
+            path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--stdio") == 0)
+        {
+            stdio = true;
+        }
+        else if (haystack_path == NULL)
+        {
+            haystack_path = argv[i];
+        }
+        else
+        {
+            haystack_path = NULL;
+            break;
+        }
+    }
+
+    if (haystack_path == NULL)
+    {
+        printf("Usage: ./findd [--raw | --index] [--socket PATH | --stdio] "
+            "FILE\n");
+        return 1;
+    }
+
+    snapshot *first = load_snapshot(haystack_path, 0);
+    if (first == NULL)
+    {
+        printf("Error! %s: %s\n", haystack_path, strerror(errno));
+        return 1;
+    }
+    atomic_store(&current, first);
+    in_use = first;
+
+    // shut down cleanly, and never die writing to a vanished client
+    struct sigaction sa = {0};
+    sa.sa_handler = stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (stdio)
+    {
+        serve_stdio();
+    }
+    else
+    {
+        int listener = listen_on(path);
+        if (listener < 0)
+        {
+            printf("Error! %s: %s\n", path, strerror(errno));
+            return 1;
+        }
+        serve(listener);
+        close(listener);
+        unlink(path);
+    }
+
+    // a reload still running owns what it loads, let it be
+    if (!atomic_load(&reloading))
+    {
+        pick_up_snapshot();
+        free_snapshot(in_use);
+    }
+    free(batch.needles);
+    free(batch.hits);
+    return 0;
+}
+
+/**
+ * Loads, sorts and lays out the haystack at path. Returns NULL with
+ * errno set on failure.
+ */
+snapshot *load_snapshot(const char *path, unsigned long generation)
+{
+    snapshot *snap = malloc(sizeof(snapshot));
+    if (snap == NULL)
+    {
+        return NULL;
+    }
+
+    if (haystack_format == INDEX)
+    {
+        // already sorted, only the layout is left to build
+        sortindex index;
+        if (!sortindex_open(&index, path, false))
+        {
+            free(snap);
+            return NULL;
+        }
+        snap->tree = eytzinger_build(index.values, index.count);
+        snap->size = index.count;
+        sortindex_close(&index);
+    }
+    else
+    {
+        haystack hay;
+        bool loaded = haystack_format == RAW ? haystack_load_raw(&hay, path)
+            : haystack_load_text(&hay, path);
+        if (!loaded)
+        {
+            free(snap);
+            return NULL;
+        }
+        sort(hay.values, hay.size);
+        snap->tree = eytzinger_build(hay.values, hay.size);
+        snap->size = hay.size;
+        haystack_free(&hay);
+    }
+
+    if (snap->tree == NULL)
+    {
+        free(snap);
+        errno = ENOMEM;
+        return NULL;
+    }
+    snap->generation = generation;
+    return snap;
+}
+
+/**
+ * Frees a snapshot.
+ */
+void free_snapshot(snapshot *snap)
+{
+    if (snap != NULL)
+    {
+        eytzinger_free(snap->tree);
+        free(snap);
+    }
+}
+
+/**
+ * Loads a haystack in the background and publishes it.
+ */
+void *reload_thread(void *path)
+{
+    snapshot *snap = load_snapshot(path, atomic_fetch_add(&generations, 1) + 1);
+    if (snap == NULL)
+    {
+        pthread_mutex_lock(&reload_error_lock);
+        // one word, so stats stays a line of name=value pairs
+        snprintf(reload_error, sizeof(reload_error), "%s:%s",
+            (char *) path, strerror(errno));
+        for (char *p = reload_error; *p != '\0'; p++)
+        {
+            *p = *p == ' ' ? '_' : *p;
+        }
+        pthread_mutex_unlock(&reload_error_lock);
+    }
+    else
+    {
+        pthread_mutex_lock(&reload_error_lock);
+        reload_error[0] = '\0';
+        pthread_mutex_unlock(&reload_error_lock);
+        atomic_store_explicit(&current, snap, memory_order_release);
+    }
+    free(path);
+    atomic_store(&reloading, false);
+    return NULL;
+}
+
+/**
+ * Starts reloading from path, NULL meaning the startup haystack, unless
+ * a reload is already running or its result has not been picked up.
+ */
+bool start_reload(const char *path, client *c)
+{
+    const char *reply = "reloading\n";
+    char *copy = strdup(path ? path : haystack_path);
+    pthread_t tid;
+    pthread_attr_t attr;
+
+    if (atomic_load(&current) != in_use || atomic_exchange(&reloading, true))
+    {
+        reply = "error reload in progress\n";
+        free(copy);
+    }
+    else if (copy == NULL)
+    {
+        reply = "error out of memory\n";
+        atomic_store(&reloading, false);
+    }
+    else
+    {
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&tid, &attr, reload_thread, copy) != 0)
+        {
+            reply = "error cannot start reload\n";
+            free(copy);
+            atomic_store(&reloading, false);
+        }
+        else
+        {
+            stats.reloads++;
+        }
+        pthread_attr_destroy(&attr);
+    }
+    return append_output(c, reply, strlen(reply));
+}
+
+/**
+ * Moves lookups on to the latest published haystack, freeing the one
+ * they were using: no lookup is running between batches, so nothing can
+ * still be reading it.
+ */
+void pick_up_snapshot(void)
+{
+    snapshot *latest = atomic_load_explicit(&current, memory_order_acquire);
+    if (latest != in_use)
+    {
+        free_snapshot(in_use);
+        in_use = latest;
+    }
+}
+
+/**
+ * Creates a non-blocking listening socket at path, replacing any stale
+ * socket file left there.
+ */
+int listen_on(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    unlink(path);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0
+        || listen(fd, SOMAXCONN) < 0)
+    {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Accepts clients and answers their queries until stopped.
+ */
+void serve(int listener)
+{
+    static client clients[MAX_CLIENTS];
+    static struct pollfd fds[MAX_CLIENTS + 1];
+    int count = 0;
+
+    while (!stopping)
+    {
+        // stop reading from clients that are not keeping up
+        fds[0] = (struct pollfd) {listener, count < MAX_CLIENTS ? POLLIN : 0, 0};
+        for (int i = 0; i < count; i++)
+        {
+            bool backed_up = clients[i].out_len > 0;
+            fds[i + 1] = (struct pollfd) {clients[i].in_fd,
+                backed_up ? POLLOUT : POLLIN, 0};
+        }
+
+        // wake now and then to pick up a reload with nobody asking
+        if (poll(fds, count + 1, atomic_load(&reloading) ? 100 : -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("poll");
+            return;
+        }
+
+        pick_up_snapshot();
+        for (int i = count - 1; i >= 0; i--)
+        {
+            short events = fds[i + 1].revents;
+            bool ok = true;
+
+            if (events & POLLOUT)
+            {
+                ok = flush_output(&clients[i]) && keep_client(&clients[i]);
+            }
+            else if (events & (POLLIN | POLLHUP | POLLERR))
+            {
+                ok = handle_input(&clients[i], false);
+            }
+
+            // swap the last client into the gap
+            if (!ok)
+            {
+                drop_client(&clients[i]);
+                clients[i] = clients[--count];
+            }
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            int fd;
+            while (count < MAX_CLIENTS
+                && (fd = accept4(listener, NULL, NULL,
+                    SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+            {
+                clients[count++] = (client) {.in_fd = fd, .out_fd = fd};
+            }
+        }
+    }
+
+    while (count > 0)
+    {
+        drop_client(&clients[--count]);
+    }
+}
+
+/**
+ * Answers queries on stdin until it ends, one read at a time.
+ */
+void serve_stdio(void)
+{
+    client c = {.in_fd = STDIN_FILENO, .out_fd = STDOUT_FILENO};
+    while (!stopping && handle_input(&c, true))
+    {
+        pick_up_snapshot();
+    }
+    free(c.in);
+    free(c.out);
+}
+
+/**
+ * Reads what the client has sent, up to MAX_READ bytes so that no client
+ * holds up the others, or with blocking waits for one read's worth,
+ * answers every complete line in it and sends the answers. Returns false if the client should be dropped, which at the
+ * end of its input waits until every answer has been sent.
+ */
+bool handle_input(client *c, bool blocking)
+{
+    bool eof = false;
+    size_t got = 0;
+    while (got < MAX_READ && c->in_len < MAX_HELD)
+    {
+        if (c->in_cap - c->in_len < READ_SIZE)
+        {
+            size_t cap = c->in_cap * 2 > c->in_len + READ_SIZE
+                ? c->in_cap * 2 : c->in_len + READ_SIZE;
+            char *in = realloc(c->in, cap);
+            if (in == NULL)
+            {
+                return false;
+            }
+            c->in = in;
+            c->in_cap = cap;
+        }
+
+        // leaving a byte to end a last line that has no newline
+        ssize_t n = read(c->in_fd, c->in + c->in_len,
+            c->in_cap - c->in_len - 1);
+        if (n == 0)
+        {
+            eof = true;
+            break;
+        }
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN)
+            {
+                break;
+            }
+            return false;
+        }
+        c->in_len += n;
+        got += n;
+        if (blocking)
+        {
+            break;
+        }
+    }
+
+    // a client that stops mid-line still gets its last answer
+    c->closing = eof;
+    return answer_lines(c, eof) && flush_output(c) && keep_client(c);
+}
+
+/**
+ * Answers every complete line of a client's input, or every line at all
+ * at eof, batching runs of queries.
+ */
+bool answer_lines(client *c, bool eof)
+{
+    double start = now();
+    size_t queries = stats.queries;
+    size_t done = 0;
+
+    while (done < c->in_len)
+    {
+        char *line = c->in + done;
+        char *end = memchr(line, '\n', c->in_len - done);
+        if (end == NULL && !eof)
+        {
+            // wait for the rest of the line, if it is not too long
+            if (c->in_len - done > MAX_LINE)
+            {
+                return false;
+            }
+            break;
+        }
+        if (end == NULL)
+        {
+            end = c->in + c->in_len;
+        }
+        done = end - c->in + (end < c->in + c->in_len);
+        *end = '\0';
+        if (end > line && end[-1] == '\r')
+        {
+            end[-1] = '\0';
+        }
+
+        // queries wait to be looked up together
+        char *rest;
+        errno = 0;
+        long value = strtol(line, &rest, 10);
+        if (rest != line && *rest == '\0' && errno == 0
+            && value >= INT_MIN && value <= INT_MAX)
+        {
+            if (batch.count == batch.cap)
+            {
+                size_t cap = batch.cap ? batch.cap * 2 : 1024;
+                int *needles = realloc(batch.needles, cap * sizeof(int));
+                unsigned char *hits = needles == NULL ? NULL
+                    : realloc(batch.hits, cap / 8 + 1);
+                if (needles != NULL)
+                {
+                    batch.needles = needles;
+                }
+                if (hits == NULL)
+                {
+                    return false;
+                }
+                batch.hits = hits;
+                batch.cap = cap;
+            }
+            batch.needles[batch.count++] = value;
+            continue;
+        }
+
+        // anything else answers after the queries before it
+        if (!look_up_pending(c) || !answer_command(c, line))
+        {
+            return false;
+        }
+    }
+    if (!look_up_pending(c))
+    {
+        return false;
+    }
+
+    // keep any partial line for next time
+    memmove(c->in, c->in + done, c->in_len - done);
+    c->in_len -= done;
+
+    // every query of the batch waited as long as the whole batch
+    size_t answered = stats.queries - queries;
+    if (answered > 0)
+    {
+        double micros = (now() - start) * 1e6;
+        int bucket = 0;
+        while (bucket < LATENCY_BUCKETS - 1 && micros > (1 << bucket))
+        {
+            bucket++;
+        }
+        stats.latency[bucket] += answered;
+        stats.batches++;
+    }
+    return true;
+}
+
+/**
+ * Answers a line that is not a query.
+ */
+bool answer_command(client *c, char *line)
+{
+    if (strncmp(line, "reload", 6) == 0 && (line[6] == '\0' || line[6] == ' '))
+    {
+        char *path = line + 6;
+        while (*path == ' ')
+        {
+            path++;
+        }
+        return start_reload(*path ? path : NULL, c);
+    }
+
+    if (strcmp(line, "stats") != 0)
+    {
+        const char *reply = "error unknown command\n";
+        return append_output(c, reply, strlen(reply));
+    }
+
+    char reply[1024];
+    pthread_mutex_lock(&reload_error_lock);
+    int len = snprintf(reply, sizeof(reply), "stats queries=%lu hits=%lu "
+        "hit_ratio=%.4f batches=%lu size=%zu generation=%lu reloads=%lu "
+        "reloading=%d reload_error=%s latency_us=", stats.queries,
+        stats.hits, stats.queries ? (double) stats.hits / stats.queries : 0.0,
+        stats.batches, in_use->size, in_use->generation, stats.reloads,
+        (int) atomic_load(&reloading), reload_error[0] ? reload_error : "none");
+    pthread_mutex_unlock(&reload_error_lock);
+
+    // non-empty buckets, as upper bound:count
+    bool first = true;
+    for (int i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        if (stats.latency[i] > 0 && len < (int) sizeof(reply) - 32)
+        {
+            len += snprintf(reply + len, sizeof(reply) - len, "%s%d:%lu",
+                first ? "" : ",", 1 << i, stats.latency[i]);
+            first = false;
+        }
+    }
+    reply[len++] = '\n';
+    return append_output(c, reply, len);
+}
+
+/**
+ * Looks up the queries waiting in the batch and queues their answers.
+ */
+bool look_up_pending(client *c)
+{
+    if (batch.count == 0)
+    {
+        return true;
+    }
+
+    eytzinger_search_batch(in_use->tree, in_use->size, batch.needles,
+        batch.count, batch.hits);
+
+    bool ok = true;
+    for (size_t i = 0; ok && i < batch.count; i++)
+    {
+        char line[32];
+        bool hit = batch.hits[i / 8] & (1 << (i % 8));
+        int len = snprintf(line, sizeof(line), "%d %s\n", batch.needles[i],
+            hit ? "found" : "missing");
+        ok = append_output(c, line, len);
+        stats.hits += hit;
+    }
+    stats.queries += batch.count;
+    batch.count = 0;
+    return ok;
+}
+
+/**
+ * Queues len bytes to be sent to the client.
+ */
+bool append_output(client *c, const void *data, size_t len)
+{
+    if (c->out_cap - c->out_len < len)
+    {
+        size_t cap = c->out_cap * 2 > c->out_len + len
+            ? c->out_cap * 2 : c->out_len + len;
+        char *out = realloc(c->out, cap);
+        if (out == NULL)
+        {
+            return false;
+        }
+        c->out = out;
+        c->out_cap = cap;
+    }
+    memcpy(c->out + c->out_len, data, len);
+    c->out_len += len;
+    return true;
+}
+
+/**
+ * Sends as much queued output as the client takes without blocking, or
+ * all of it if its descriptor blocks.
+ */
+bool flush_output(client *c)
+{
+    while (c->out_sent < c->out_len)
+    {
+        ssize_t n = write(c->out_fd, c->out + c->out_sent,
+            c->out_len - c->out_sent);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno == EAGAIN;
+        }
+        c->out_sent += n;
+    }
+
+    c->out_len = 0;
+    c->out_sent = 0;
+    return true;
+}
+
+/**
+ * Returns false once a client whose input has ended has been sent
+ * everything queued for it.
+ */
+bool keep_client(const client *c)
+{
+    return !c->closing || c->out_len > 0;
+}
+
+/**
+ * Closes a client's connection and frees its buffers.
+ */
+void drop_client(client *c)
+{
+    close(c->in_fd);
+    free(c->in);
+    free(c->out);
+}
+
+/**
+ * Returns the current time in seconds.
+ */
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Asks the main loop to stop.
+ */
+void stop(int signal)
+{
+    (void) signal;
+    stopping = 1;
+}
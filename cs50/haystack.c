@@ -0,0 +1,249 @@
+/**
+ * haystack.c
+ *
+ * Bulk loading of find's haystack from a file.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "haystack.h"
+
+// bytes read at a time from files that cannot be mapped
+#define READ_CHUNK (1 << 20)
+
+// values room is first made for
+#define INITIAL_VALUES 4096
+
+// state of the text parser, carried across chunks
+typedef struct
+{
+    int64_t value;      // digits of the number so far
+    bool negative;      // saw a leading '-'
+    bool in_number;     // in the middle of a number
+    size_t cap;         // room in values
+}
+parser;
+
+bool haystack_load_raw(haystack *hay, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return false;
+    }
+    if (st.st_size % sizeof(int32_t) != 0
+        || st.st_size / sizeof(int32_t) > INT_MAX)
+    {
+        close(fd);
+        errno = EINVAL;
+        return false;
+    }
+
+    hay->size = st.st_size / sizeof(int32_t);
+    hay->map = NULL;
+    hay->map_len = st.st_size;
+    hay->values = NULL;
+    if (hay->size > 0)
+    {
+        hay->map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+            fd, 0);
+    }
+    int saved = errno;
+    close(fd);
+    if (hay->map == MAP_FAILED)
+    {
+        errno = saved;
+        return false;
+    }
+    hay->values = hay->map;
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (size_t i = 0; i < hay->size; i++)
+    {
+        hay->values[i] = __builtin_bswap32(hay->values[i]);
+    }
+#endif
+    return true;
+}
+
+/**
+ * Adds a finished number to the haystack, growing it if need be.
+ */
+static bool push_value(haystack *hay, parser *p)
+{
+    int64_t value = p->negative ? -p->value : p->value;
+    if (value < INT_MIN || value > INT_MAX || hay->size == INT_MAX)
+    {
+        errno = ERANGE;
+        return false;
+    }
+
+    if (hay->size == p->cap)
+    {
+        size_t cap = p->cap ? p->cap * 2 : INITIAL_VALUES;
+        int *values = realloc(hay->values, cap * sizeof(int));
+        if (values == NULL)
+        {
+            return false;
+        }
+        hay->values = values;
+        p->cap = cap;
+    }
+
+    hay->values[hay->size++] = value;
+    p->value = 0;
+    p->negative = false;
+    p->in_number = false;
+    return true;
+}
+
+/**
+ * Parses len bytes of text, which may stop or start part way through a
+ * number.
+ */
+static bool parse(haystack *hay, parser *p, const char *text, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned int digit = (unsigned char) text[i] - '0';
+        if (digit < 10)
+        {
+            p->value = p->value * 10 + digit;
+            p->in_number = true;
+
+            // more than 10 digits cannot fit, stop before int64 overflows
+            if (p->value > (int64_t) INT_MAX + 1)
+            {
+                errno = ERANGE;
+                return false;
+            }
+            continue;
+        }
+
+        if (p->in_number && !push_value(hay, p))
+        {
+            return false;
+        }
+
+        char c = text[i];
+        if (c == '-')
+        {
+            p->negative = true;
+        }
+        else if (c != ' ' && c != '\n' && c != '\t' && c != '\r' && c != ',')
+        {
+            errno = EINVAL;
+            return false;
+        }
+        else if (p->negative)
+        {
+            // a '-' on its own
+            errno = EINVAL;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool haystack_load_text(haystack *hay, const char *path)
+{
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    *hay = (haystack) {NULL, 0, NULL, 0};
+    parser p = {0, false, false, 0};
+    bool ok = true;
+
+    // parse regular files in place, read anything else a chunk at a time
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    if (map != MAP_FAILED)
+    {
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        ok = parse(hay, &p, map, st.st_size);
+        munmap(map, st.st_size);
+    }
+    else
+    {
+        char *buf = malloc(READ_CHUNK);
+        ok = buf != NULL;
+        while (ok)
+        {
+            ssize_t n = read(fd, buf, READ_CHUNK);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                ok = n == 0;
+                break;
+            }
+            ok = parse(hay, &p, buf, n);
+        }
+        free(buf);
+    }
+
+    // the last number may not have anything after it
+    if (ok && p.in_number)
+    {
+        ok = push_value(hay, &p);
+    }
+    if (ok && p.negative)
+    {
+        errno = EINVAL;
+        ok = false;
+    }
+
+    int saved = errno;
+    if (fd != STDIN_FILENO)
+    {
+        close(fd);
+    }
+    if (!ok)
+    {
+        haystack_free(hay);
+    }
+    errno = saved;
+    return ok;
+}
+
+void haystack_free(haystack *hay)
+{
+    if (hay->map != NULL)
+    {
+        munmap(hay->map, hay->map_len);
+    }
+    else
+    {
+        free(hay->values);
+    }
+    *hay = (haystack) {NULL, 0, NULL, 0};
+}
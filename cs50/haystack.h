@@ -0,0 +1,56 @@
+/**
+ * haystack.h
+ *
+ * Bulk loading of find's haystack from a file, instead of prompting for
+ * one value at a time.
+ */
+
+#ifndef HAYSTACK_H
+#define HAYSTACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct
+{
+    int *values;        // the hay, writable so it can be sorted in place
+    size_t size;        // number of values
+    void *map;          // mapping holding values, NULL if on the heap
+    size_t map_len;     // length of the mapping
+}
+haystack;
+
+/**
+ * Maps a file of raw little-endian 32 bit ints. The mapping is private,
+ * so sorting it only copies the pages it touches and leaves the file
+ * alone.
+ *
+ * @param haystack* hay The haystack to fill in
+ * @param const char* path The file to map
+ *
+ * @return bool false with errno set on failure
+ */
+bool haystack_load_raw(haystack *hay, const char *path);
+
+/**
+ * Parses a file of ints in decimal, one or more per line separated by
+ * whitespace or commas, into a buffer that grows as needed. "-" reads
+ * stdin.
+ *
+ * @param haystack* hay The haystack to fill in
+ * @param const char* path The file to read
+ *
+ * @return bool false with errno set on failure, EINVAL for bad input
+ */
+bool haystack_load_text(haystack *hay, const char *path);
+
+/**
+ * Frees a loaded haystack.
+ *
+ * @param haystack* hay The haystack
+ *
+ * @return void
+ */
+void haystack_free(haystack *hay);
+
+#endif
@@ -0,0 +1,321 @@
+/**
+ * helpers.c
+ *
+ * Computer Science 50
+ * Problem Set 3
+ *
+ * Helper functions for Problem Set 3.
+ *
+ * sort() is an LSD radix sort on bytes for all but tiny arrays, which get
+ * insertion sort. Flipping the sign bit makes signed ints order as
+ * unsigned keys. Big arrays are split across threads: per pass, every
+ * thread counts its slice's digits, a prefix sum over (digit, thread)
+ * gives each thread its own output positions, and all threads scatter at
+ * once. Passes where every value has the same digit are skipped.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "helpers.h"
+
+// arrays up to this size are insertion sorted
+#define INSERTION_CUTOFF 64
+
+// arrays from this size up are radix sorted with threads
+#define PARALLEL_CUTOFF (1 << 20)
+
+// most threads sort will start
+#define MAX_THREADS 64
+
+// radix of one pass
+#define BUCKETS 256
+
+/**
+ * Maps a signed value to an unsigned key with the same order.
+ */
+static inline uint32_t radix_key(int value)
+{
+    return (uint32_t) value ^ 0x80000000u;
+}
+
+/**
+ * Sorts array of n values by insertion, for small arrays.
+ */
+void sort_insertion(int values[], int n)
+{
+    for (int i = 1; i < n; i++)
+    {
+        int value = values[i];
+        int j = i;
+        for (; j > 0 && values[j - 1] > value; j--)
+        {
+            values[j] = values[j - 1];
+        }
+        values[j] = value;
+    }
+}
+
+/**
+ * Orders ints for qsort.
+ */
+static int compare_ints(const void *a, const void *b)
+{
+    int x = *(const int *) a;
+    int y = *(const int *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Single threaded radix sort, counting every pass's digits in one read.
+ * Returns whichever of values and tmp ends up holding the result.
+ */
+static int *radix_sort(int *values, int *tmp, size_t n)
+{
+    size_t counts[4][BUCKETS] = {{0}};
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t key = radix_key(values[i]);
+        counts[0][key & 0xff]++;
+        counts[1][(key >> 8) & 0xff]++;
+        counts[2][(key >> 16) & 0xff]++;
+        counts[3][key >> 24]++;
+    }
+
+    int *src = values;
+    int *dst = tmp;
+    for (int pass = 0; pass < 4; pass++)
+    {
+        int shift = pass * 8;
+
+        // skip passes that would not move anything
+        size_t offsets[BUCKETS];
+        size_t total = 0;
+        bool trivial = false;
+        for (int b = 0; b < BUCKETS; b++)
+        {
+            trivial |= counts[pass][b] == n;
+            offsets[b] = total;
+            total += counts[pass][b];
+        }
+        if (trivial)
+        {
+            continue;
+        }
+
+        for (size_t i = 0; i < n; i++)
+        {
+            dst[offsets[(radix_key(src[i]) >> shift) & 0xff]++] = src[i];
+        }
+
+        int *swap = src;
+        src = dst;
+        dst = swap;
+    }
+    return src;
+}
+
+// one thread's slice of a parallel radix sort pass
+typedef struct
+{
+    const int *src;
+    int *dst;
+    size_t begin;
+    size_t end;
+    int shift;
+    size_t counts[BUCKETS];     // digits in the slice, then where they go
+}
+radix_slice;
+
+/**
+ * Counts the digits of one slice.
+ */
+static void *count_slice(void *arg)
+{
+    radix_slice *s = arg;
+    memset(s->counts, 0, sizeof(s->counts));
+    for (size_t i = s->begin; i < s->end; i++)
+    {
+        s->counts[(radix_key(s->src[i]) >> s->shift) & 0xff]++;
+    }
+    return NULL;
+}
+
+/**
+ * Scatters one slice to the positions the prefix sum gave it.
+ */
+static void *scatter_slice(void *arg)
+{
+    radix_slice *s = arg;
+    for (size_t i = s->begin; i < s->end; i++)
+    {
+        int value = s->src[i];
+        s->dst[s->counts[(radix_key(value) >> s->shift) & 0xff]++] = value;
+    }
+    return NULL;
+}
+
+/**
+ * Runs worker over every slice, one thread each, with the calling thread
+ * taking the first. Slices whose thread cannot start run on the caller.
+ */
+static void run_slices(void *(*worker)(void *), radix_slice *slices,
+    int count)
+{
+    pthread_t tids[MAX_THREADS];
+    bool started[MAX_THREADS];
+
+    for (int i = 1; i < count; i++)
+    {
+        started[i] = pthread_create(&tids[i], NULL, worker, &slices[i]) == 0;
+    }
+    worker(&slices[0]);
+    for (int i = 1; i < count; i++)
+    {
+        if (started[i])
+        {
+            pthread_join(tids[i], NULL);
+        }
+        else
+        {
+            worker(&slices[i]);
+        }
+    }
+}
+
+/**
+ * Radix sort with every pass split across threads. Returns whichever of
+ * values and tmp ends up holding the result.
+ */
+static int *radix_sort_parallel(int *values, int *tmp, size_t n, int threads)
+{
+    radix_slice slices[MAX_THREADS];
+    int *src = values;
+    int *dst = tmp;
+
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        for (int t = 0; t < threads; t++)
+        {
+            slices[t].src = src;
+            slices[t].dst = dst;
+            slices[t].begin = n * t / threads;
+            slices[t].end = n * (t + 1) / threads;
+            slices[t].shift = shift;
+        }
+        run_slices(count_slice, slices, threads);
+
+        // exclusive prefix sum, digit major, so each thread's values
+        // with a digit follow the previous thread's with that digit
+        size_t total = 0;
+        bool trivial = false;
+        for (int b = 0; b < BUCKETS; b++)
+        {
+            size_t bucket = 0;
+            for (int t = 0; t < threads; t++)
+            {
+                size_t count = slices[t].counts[b];
+                slices[t].counts[b] = total;
+                total += count;
+                bucket += count;
+            }
+            trivial |= bucket == n;
+        }
+        if (trivial)
+        {
+            continue;
+        }
+
+        run_slices(scatter_slice, slices, threads);
+
+        int *swap = src;
+        src = dst;
+        dst = swap;
+    }
+    return src;
+}
+
+/**
+ * Returns true if value is in array of n values, else false.
+ */
+bool search(int value, int values[], int n)
+{
+    int low = 0;
+    int high = n - 1;
+
+    while (low <= high)
+    {
+        int middle = low + (high - low) / 2;
+        if (values[middle] == value)
+        {
+            return true;
+        }
+        else if (values[middle] < value)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    return false;
+}
+
+/**
+ * Sorts array of n values by LSD radix sort, split across threads.
+ */
+void sort_radix(int values[], int n, int threads)
+{
+    int *tmp = malloc((size_t) n * sizeof(int));
+    if (tmp == NULL)
+    {
+        // no room for a radix sort, fall back on the library
+        qsort(values, n, sizeof(int), compare_ints);
+        return;
+    }
+
+    if (threads > MAX_THREADS)
+    {
+        threads = MAX_THREADS;
+    }
+
+    int *sorted = threads > 1
+        ? radix_sort_parallel(values, tmp, n, threads)
+        : radix_sort(values, tmp, n);
+    if (sorted != values)
+    {
+        memcpy(values, sorted, (size_t) n * sizeof(int));
+    }
+    free(tmp);
+}
+
+/**
+ * Returns the number of threads sort() splits n values across.
+ */
+int sort_threads(int n)
+{
+    int threads = n >= PARALLEL_CUTOFF ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+    if (threads < 1)
+    {
+        threads = 1;
+    }
+    return threads > MAX_THREADS ? MAX_THREADS : threads;
+}
+
+/**
+ * Sorts array of n values.
+ */
+void sort(int values[], int n)
+{
+    if (n <= INSERTION_CUTOFF)
+    {
+        sort_insertion(values, n);
+        return;
+    }
+
+    sort_radix(values, n, sort_threads(n));
+}
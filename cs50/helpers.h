@@ -0,0 +1,35 @@
+/**
+ * helpers.h
+ *
+ * Computer Science 50
+ * Problem Set 3
+ *
+ * Helper functions for Problem Set 3.
+ */
+ 
+#include <cs50.h>
+
+/**
+ * Returns true if value is in array of n values, else false.
+ */
+bool search(int value, int values[], int n);
+
+/**
+ * Sorts array of n values.
+ */
+void sort(int values[], int n);
+
+/**
+ * Returns the number of threads sort() splits n values across.
+ */
+int sort_threads(int n);
+
+/**
+ * Sorts array of n values by insertion, for small arrays.
+ */
+void sort_insertion(int values[], int n);
+
+/**
+ * Sorts array of n values by LSD radix sort, split across threads.
+ */
+void sort_radix(int values[], int n, int threads);
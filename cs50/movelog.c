@@ -0,0 +1,379 @@
+/**
+ * movelog.c
+ *
+ * Binary log of a game of fifteen.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "movelog.h"
+
+// value of the blank in save()'s text
+#define TEXT_BLANK 95
+
+// a board being replayed
+typedef struct
+{
+    puzzle p;
+    uint8_t where[PUZZLE_CELLS];    // cell of every tile
+}
+replayer;
+
+/**
+ * Returns the bytes of a checkpoint on a d x d board.
+ */
+static size_t checkpoint_size(int d)
+{
+    return 1 + sizeof(uint64_t) + d * d;
+}
+
+/**
+ * Flushes the buffer, then syncs if sync is set.
+ */
+static bool flush(movelog_writer *w, bool sync)
+{
+    if (!outbuf_flush(&w->out))
+    {
+        return false;
+    }
+    w->unflushed = 0;
+    return !sync || fsync(w->out.fd) == 0;
+}
+
+/**
+ * Loads the checkpoint at offset into rp, returning false if its board
+ * does not hold every tile once.
+ */
+static bool load_checkpoint(const movelog_reader *r, size_t offset,
+    replayer *rp)
+{
+    const uint8_t *cells = r->data + offset + 1 + sizeof(uint64_t);
+    bool seen[PUZZLE_CELLS] = { false };
+    memset(&rp->p, 0, sizeof(rp->p));
+    rp->p.d = r->d;
+    for (int cell = 0; cell < r->d * r->d; cell++)
+    {
+        int tile = cells[cell];
+        if (tile >= r->d * r->d || seen[tile])
+        {
+            return false;
+        }
+        seen[tile] = true;
+        rp->p.cells[cell] = tile;
+        rp->where[tile] = cell;
+    }
+    rp->p.blank = rp->where[0];
+    return true;
+}
+
+/**
+ * Plays a turn, moving tile into the blank if it is next to it.
+ */
+static void play(replayer *rp, int tile)
+{
+    if (tile == 0)
+    {
+        return;
+    }
+    int d = rp->p.d;
+    int cell = rp->where[tile];
+    int blank = rp->p.blank;
+    if (abs(cell / d - blank / d) + abs(cell % d - blank % d) != 1)
+    {
+        return;
+    }
+    rp->p.cells[blank] = tile;
+    rp->p.cells[cell] = 0;
+    rp->where[tile] = blank;
+    rp->where[0] = cell;
+    rp->p.blank = cell;
+}
+
+bool movelog_begin(movelog_writer *w, const char *path, const puzzle *start,
+    const movelog_policy *policy)
+{
+    *w = (movelog_writer) {.d = start->d, .policy = *policy};
+    if (w->policy.checkpoint_every == 0)
+    {
+        w->policy.checkpoint_every = MOVELOG_CHECKPOINT_EVERY;
+    }
+    if (!outbuf_open(&w->out, path, OUTBUF_SIZE, false))
+    {
+        return false;
+    }
+
+    movelog_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MOVELOG_MAGIC, sizeof(header.magic));
+    header.version = MOVELOG_VERSION;
+    header.d = start->d;
+    header.checkpoint_every = w->policy.checkpoint_every;
+    if (!outbuf_append(&w->out, (char *) &header, sizeof(header))
+        || !movelog_checkpoint(w, start))
+    {
+        int saved = errno;
+        outbuf_close(&w->out);
+        errno = saved;
+        return false;
+    }
+    return true;
+}
+
+bool movelog_turn(movelog_writer *w, int tile)
+{
+    char record = tile >= 1 && tile < w->d * w->d ? tile : 0;
+    if (!outbuf_append(&w->out, &record, 1))
+    {
+        return false;
+    }
+    w->turns++;
+    w->unflushed++;
+    if (w->policy.flush_every > 0 && w->unflushed >= w->policy.flush_every)
+    {
+        return flush(w, w->policy.sync == MOVELOG_SYNC_FLUSH);
+    }
+    return true;
+}
+
+bool movelog_checkpoint_due(const movelog_writer *w)
+{
+    return w->turns % w->policy.checkpoint_every == 0;
+}
+
+bool movelog_checkpoint(movelog_writer *w, const puzzle *board)
+{
+    char *record = outbuf_reserve(&w->out, checkpoint_size(w->d));
+    if (record == NULL)
+    {
+        return false;
+    }
+    record[0] = (char) MOVELOG_CHECKPOINT;
+    for (size_t i = 0; i < sizeof(uint64_t); i++)
+    {
+        record[1 + i] = w->turns >> (8 * i);
+    }
+    memcpy(record + 1 + sizeof(uint64_t), board->cells, w->d * w->d);
+    if (!outbuf_commit(&w->out, checkpoint_size(w->d)))
+    {
+        return false;
+    }
+    if (w->policy.sync != MOVELOG_SYNC_NEVER)
+    {
+        return flush(w, true);
+    }
+    return true;
+}
+
+bool movelog_end(movelog_writer *w)
+{
+    bool ok = flush(w, w->policy.sync != MOVELOG_SYNC_NEVER);
+    int saved = errno;
+    if (!outbuf_close(&w->out) && ok)
+    {
+        ok = false;
+        saved = errno;
+    }
+    errno = saved;
+    return ok;
+}
+
+bool movelog_open(movelog_reader *r, const char *path)
+{
+    memset(r, 0, sizeof(*r));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(movelog_header))
+    {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    else
+    {
+        errno = EINVAL;
+    }
+    int saved = errno;
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        errno = saved;
+        return false;
+    }
+    r->map = map;
+    r->map_len = st.st_size;
+    r->data = map;
+
+    const movelog_header *header = map;
+    bool valid = memcmp(header->magic, MOVELOG_MAGIC, sizeof(header->magic)) == 0
+        && header->version == MOVELOG_VERSION
+        && header->d >= 2 && header->d <= PUZZLE_MAX;
+    r->d = header->d;
+
+    // find every checkpoint, checking turns are tiles and checkpoints in
+    // step, the first at the start
+    size_t pos = sizeof(*header);
+    size_t cap = 0;
+    while (valid && pos < r->map_len)
+    {
+        if (r->data[pos] != MOVELOG_CHECKPOINT)
+        {
+            valid = r->checkpoint_count > 0 && r->data[pos] < r->d * r->d;
+            r->turns++;
+            pos++;
+            continue;
+        }
+        if (r->map_len - pos < checkpoint_size(r->d))
+        {
+            break;
+        }
+        uint64_t turn = 0;
+        for (size_t i = 0; i < sizeof(uint64_t); i++)
+        {
+            turn |= (uint64_t) r->data[pos + 1 + i] << (8 * i);
+        }
+        if (turn != r->turns)
+        {
+            valid = false;
+            break;
+        }
+        if (r->checkpoint_count == cap)
+        {
+            cap = cap == 0 ? 64 : cap * 2;
+            movelog_mark *grown = realloc(r->checkpoints,
+                cap * sizeof(movelog_mark));
+            if (grown == NULL)
+            {
+                movelog_close(r);
+                errno = ENOMEM;
+                return false;
+            }
+            r->checkpoints = grown;
+        }
+        r->checkpoints[r->checkpoint_count++] = (movelog_mark) {turn, pos};
+        pos += checkpoint_size(r->d);
+    }
+    r->len = pos;
+
+    if (!valid || r->checkpoint_count == 0)
+    {
+        movelog_close(r);
+        errno = EINVAL;
+        return false;
+    }
+    return true;
+}
+
+void movelog_close(movelog_reader *r)
+{
+    if (r->map != NULL)
+    {
+        munmap(r->map, r->map_len);
+    }
+    free(r->checkpoints);
+    memset(r, 0, sizeof(*r));
+}
+
+bool movelog_replay(const movelog_reader *r, uint64_t first, uint64_t last,
+    bool (*visit)(const puzzle *board, uint64_t turn, void *state),
+    void *state)
+{
+    // the last checkpoint at or before first
+    size_t lo = 0, hi = r->checkpoint_count;
+    while (hi - lo > 1)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (r->checkpoints[mid].turn <= first)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    replayer rp;
+    size_t pos = r->checkpoints[lo].offset;
+    uint64_t turn = r->checkpoints[lo].turn;
+    if (!load_checkpoint(r, pos, &rp))
+    {
+        errno = EINVAL;
+        return false;
+    }
+    pos += checkpoint_size(r->d);
+    if (turn >= first && !visit(&rp.p, turn, state))
+    {
+        return false;
+    }
+
+    while (turn < last && pos < r->len)
+    {
+        if (r->data[pos] == MOVELOG_CHECKPOINT)
+        {
+            // every checkpoint must agree with the turns before it
+            const uint8_t *cells = r->data + pos + 1 + sizeof(uint64_t);
+            if (memcmp(cells, rp.p.cells, r->d * r->d) != 0)
+            {
+                errno = EINVAL;
+                return false;
+            }
+            pos += checkpoint_size(r->d);
+            continue;
+        }
+        play(&rp, r->data[pos++]);
+        turn++;
+        if (turn >= first && !visit(&rp.p, turn, state))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t movelog_format(const puzzle *board, char text[])
+{
+    size_t len = 0;
+    int d = board->d;
+    text[len++] = '{';
+    for (int i = 0; i < d; i++)
+    {
+        text[len++] = '{';
+        for (int j = 0; j < d; j++)
+        {
+            int tile = board->cells[i * d + j];
+            if (tile == 0)
+            {
+                tile = TEXT_BLANK;
+            }
+            if (tile >= 10)
+            {
+                text[len++] = '0' + tile / 10;
+            }
+            text[len++] = '0' + tile % 10;
+            if (j < d - 1)
+            {
+                text[len++] = ',';
+            }
+        }
+        text[len++] = '}';
+        if (i < d - 1)
+        {
+            text[len++] = ',';
+        }
+    }
+    text[len++] = '}';
+    text[len++] = '\n';
+    return len;
+}
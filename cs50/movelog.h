@@ -0,0 +1,204 @@
+/**
+ * movelog.h
+ *
+ * Binary log of a game of fifteen, kept open for the whole game and
+ * written through a buffer. After a header, every turn takes one byte,
+ * the tile the player asked to move, and every so many turns a
+ * checkpoint holds the whole board, so a reader can start from the
+ * nearest one rather than from the first turn. The first record is
+ * always a checkpoint of the starting board.
+ *
+ * Records:
+ *   turn        the tile, 1 to d*d - 1, or 0 for a turn that asked for
+ *               no tile; turns that cannot move their tile change nothing
+ *   checkpoint  MOVELOG_CHECKPOINT, the turns before it as 8 bytes,
+ *               lowest first, then the tile in every cell, 0 the blank
+ */
+
+#ifndef MOVELOG_H
+#define MOVELOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "outbuf.h"
+#include "solver.h"
+
+// identifies a move log, and the layout version this code writes
+#define MOVELOG_MAGIC "FIFTLOG"
+#define MOVELOG_VERSION 1
+
+// first byte of a checkpoint, which no tile is
+#define MOVELOG_CHECKPOINT 0xff
+
+// default turns between checkpoints
+#define MOVELOG_CHECKPOINT_EVERY 1024
+
+// longest board save() logs as text, {{..},..} with two digit tiles
+#define MOVELOG_TEXT_MAX (PUZZLE_CELLS * 3 + PUZZLE_MAX * 3 + 3)
+
+// when a log's file is synced to disk
+enum
+{
+    MOVELOG_SYNC_NEVER,         // left to the kernel
+    MOVELOG_SYNC_CHECKPOINT,    // after every checkpoint
+    MOVELOG_SYNC_FLUSH          // after every flush
+};
+
+// start of every move log, 32 bytes
+typedef struct
+{
+    char magic[8];              // MOVELOG_MAGIC
+    uint32_t version;           // MOVELOG_VERSION
+    uint32_t d;                 // board's dimension
+    uint32_t checkpoint_every;  // turns between checkpoints
+    uint8_t reserved[12];
+}
+movelog_header;
+
+// how often a log writes its buffer out and syncs it
+typedef struct
+{
+    unsigned checkpoint_every;  // turns between checkpoints
+    unsigned flush_every;       // turns between flushes, 0 when full
+    int sync;                   // MOVELOG_SYNC_*
+}
+movelog_policy;
+
+// a log being written
+typedef struct
+{
+    outbuf out;
+    int d;
+    uint64_t turns;
+    movelog_policy policy;
+    unsigned unflushed;         // turns since the last flush
+}
+movelog_writer;
+
+// a checkpoint found by a reader
+typedef struct
+{
+    uint64_t turn;              // turns before it
+    size_t offset;              // of its first byte
+}
+movelog_mark;
+
+// a log mapped for reading
+typedef struct
+{
+    const uint8_t *data;
+    size_t len;                 // of the complete records
+    int d;
+    uint64_t turns;
+    movelog_mark *checkpoints;
+    size_t checkpoint_count;
+    void *map;
+    size_t map_len;
+}
+movelog_reader;
+
+/**
+ * Creates a log at path for a game starting from start, writing the
+ * header and a first checkpoint.
+ *
+ * @param movelog_writer* w The writer to set up
+ * @param const char* path The file to create
+ * @param const puzzle* start The starting board
+ * @param const movelog_policy* policy When to checkpoint, flush and sync
+ *
+ * @return bool false with errno set on failure
+ */
+bool movelog_begin(movelog_writer *w, const char *path, const puzzle *start,
+    const movelog_policy *policy);
+
+/**
+ * Appends a turn, flushing and syncing as the policy says.
+ *
+ * @param movelog_writer* w The writer
+ * @param int tile The tile asked for, anything but a tile logged as 0
+ *
+ * @return bool false with errno set on failure
+ */
+bool movelog_turn(movelog_writer *w, int tile);
+
+/**
+ * Returns true if the policy wants a checkpoint after the last turn.
+ *
+ * @param const movelog_writer* w The writer
+ *
+ * @return bool Whether to call movelog_checkpoint
+ */
+bool movelog_checkpoint_due(const movelog_writer *w);
+
+/**
+ * Appends a checkpoint of the board as it is after the last turn.
+ *
+ * @param movelog_writer* w The writer
+ * @param const puzzle* board The board
+ *
+ * @return bool false with errno set on failure
+ */
+bool movelog_checkpoint(movelog_writer *w, const puzzle *board);
+
+/**
+ * Flushes, syncs unless the policy is MOVELOG_SYNC_NEVER, and closes
+ * the log.
+ *
+ * @param movelog_writer* w The writer
+ *
+ * @return bool false with errno set on failure
+ */
+bool movelog_end(movelog_writer *w);
+
+/**
+ * Maps the log at path and finds its checkpoints. A record cut short at
+ * the end, by a game that died mid-write, is left out.
+ *
+ * @param movelog_reader* r The reader to set up
+ * @param const char* path The file to map
+ *
+ * @return bool false with errno set on failure, EINVAL if not a log
+ */
+bool movelog_open(movelog_reader *r, const char *path);
+
+/**
+ * Unmaps a log.
+ *
+ * @param movelog_reader* r The reader
+ *
+ * @return void
+ */
+void movelog_close(movelog_reader *r);
+
+/**
+ * Calls visit with the board after every turn from turn first to turn
+ * last, 0 being the start, inclusive, starting from the checkpoint
+ * nearest first, until visit returns false.
+ *
+ * @param const movelog_reader* r The reader
+ * @param uint64_t first The first turn to visit
+ * @param uint64_t last The last turn to visit
+ * @param visit Called with every board and its turn
+ * @param void* state Passed to visit
+ *
+ * @return bool false with errno set to EINVAL if a record is corrupt,
+ *         or if visit returned false
+ */
+bool movelog_replay(const movelog_reader *r, uint64_t first, uint64_t last,
+    bool (*visit)(const puzzle *board, uint64_t turn, void *state),
+    void *state);
+
+/**
+ * Writes a board as save() used to log it, e.g. {{8,7,6},{5,4,3},{2,1,95}}
+ * with the blank as 95 and a newline, to text.
+ *
+ * @param const puzzle* board The board
+ * @param char* text Room for MOVELOG_TEXT_MAX bytes
+ *
+ * @return size_t The bytes written
+ */
+size_t movelog_format(const puzzle *board, char text[]);
+
+#endif
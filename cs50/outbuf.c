@@ -0,0 +1,250 @@
+/**
+ * outbuf.c
+ *
+ * Buffered output writer for the cypher tools.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "outbuf.h"
+
+// room for the suffix of a file replacing another, .PID.ATTEMPT.tmp
+#define TEMP_SUFFIX 48
+
+// names tried for that file before giving up
+#define TEMP_ATTEMPTS 100
+
+/**
+ * Writes every byte described by iov, retrying short and interrupted
+ * writes. iov is modified.
+ */
+static bool write_segments(int fd, struct iovec *iov, int count)
+{
+    while (count > 0)
+    {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+
+        // skip whatever was written
+        while (count > 0 && (size_t) n >= iov->iov_len)
+        {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0)
+        {
+            iov->iov_base = (char *) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return true;
+}
+
+/**
+ * Gives an open file a buffer of cap bytes, closing it on failure.
+ */
+static bool start(outbuf *out, int fd, size_t cap, bool unbuffered)
+{
+    out->fd = fd;
+    out->data = malloc(cap);
+    if (out->data == NULL)
+    {
+        if (out->fd != STDOUT_FILENO)
+        {
+            close(out->fd);
+        }
+        errno = ENOMEM;
+        return false;
+    }
+
+    out->len = 0;
+    out->cap = cap;
+    out->unbuffered = unbuffered;
+    out->temp = NULL;
+    out->target = NULL;
+    return true;
+}
+
+/**
+ * Removes a file being written to replace another and forgets both.
+ */
+static void discard_temp(outbuf *out)
+{
+    if (out->temp != NULL)
+    {
+        unlink(out->temp);
+    }
+    free(out->temp);
+    free(out->target);
+    out->temp = NULL;
+    out->target = NULL;
+}
+
+bool outbuf_open(outbuf *out, const char *path, size_t cap, bool unbuffered)
+{
+    int fd = strcmp(path, "-") == 0 ? STDOUT_FILENO
+        : open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    return start(out, fd, cap, unbuffered);
+}
+
+bool outbuf_open_replace(outbuf *out, const char *path, size_t cap)
+{
+    size_t len = strlen(path) + TEMP_SUFFIX;
+    char *temp = malloc(len);
+    char *target = strdup(path);
+    if (temp == NULL || target == NULL)
+    {
+        free(temp);
+        free(target);
+        errno = ENOMEM;
+        return false;
+    }
+
+    // a name of its own, so that writers never share a file
+    int fd = -1;
+    for (int attempt = 0; fd < 0; attempt++)
+    {
+        snprintf(temp, len, "%s.%ld.%d.tmp", path, (long) getpid(), attempt);
+        fd = open(temp, O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (fd < 0 && (errno != EEXIST || attempt == TEMP_ATTEMPTS))
+        {
+            int saved = errno;
+            free(temp);
+            free(target);
+            errno = saved;
+            return false;
+        }
+    }
+
+    if (!start(out, fd, cap, false))
+    {
+        unlink(temp);
+        free(temp);
+        free(target);
+        errno = ENOMEM;
+        return false;
+    }
+    out->temp = temp;
+    out->target = target;
+    return true;
+}
+
+bool outbuf_flush(outbuf *out)
+{
+    if (out->len == 0)
+    {
+        return true;
+    }
+
+    struct iovec iov = {out->data, out->len};
+    out->len = 0;
+    return write_segments(out->fd, &iov, 1);
+}
+
+char *outbuf_reserve(outbuf *out, size_t len)
+{
+    if (out->cap - out->len < len && !outbuf_flush(out))
+    {
+        return NULL;
+    }
+    return out->data + out->len;
+}
+
+bool outbuf_commit(outbuf *out, size_t len)
+{
+    out->len += len;
+    if (out->unbuffered || out->len == out->cap)
+    {
+        return outbuf_flush(out);
+    }
+    return true;
+}
+
+bool outbuf_append(outbuf *out, const char *data, size_t len)
+{
+    // small appends are copied into the buffer
+    if (len < out->cap / 2)
+    {
+        char *dest = outbuf_reserve(out, len);
+        if (dest == NULL)
+        {
+            return false;
+        }
+        memcpy(dest, data, len);
+        return outbuf_commit(out, len);
+    }
+
+    // big ones go out straight away, behind whatever is buffered
+    struct iovec iov[2] = {
+        {out->data, out->len},
+        {(void *) data, len},
+    };
+    out->len = 0;
+    return write_segments(out->fd, iov, 2);
+}
+
+bool outbuf_close(outbuf *out)
+{
+    bool ok = outbuf_flush(out);
+    int saved = errno;
+
+    free(out->data);
+    out->data = NULL;
+    if (out->fd != STDOUT_FILENO && close(out->fd) != 0 && ok)
+    {
+        ok = false;
+        saved = errno;
+    }
+    discard_temp(out);
+
+    errno = saved;
+    return ok;
+}
+
+bool outbuf_replace(outbuf *out)
+{
+    bool ok = outbuf_flush(out) && fsync(out->fd) == 0;
+    int saved = errno;
+
+    free(out->data);
+    out->data = NULL;
+    if (close(out->fd) != 0 && ok)
+    {
+        ok = false;
+        saved = errno;
+    }
+    if (ok && rename(out->temp, out->target) != 0)
+    {
+        ok = false;
+        saved = errno;
+    }
+
+    // renamed, there is nothing left to remove
+    if (ok)
+    {
+        free(out->temp);
+        out->temp = NULL;
+    }
+    discard_temp(out);
+
+    errno = saved;
+    return ok;
+}
@@ -0,0 +1,119 @@
+/**
+ * outbuf.h
+ *
+ * Buffered output writer for the cypher tools. Output is collected in one
+ * large buffer and handed to the kernel with a single write(2) when the
+ * buffer fills up or is closed, instead of going through stdio a byte at
+ * a time.
+ */
+
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// default buffer size
+#define OUTBUF_SIZE (1 << 20)
+
+typedef struct
+{
+    int fd;             // where the output goes
+    char *data;         // buffered bytes not yet written
+    size_t len;         // number of buffered bytes
+    size_t cap;         // size of data
+    bool unbuffered;    // write every append straight away
+    char *temp;         // file being written to replace target, if any
+    char *target;
+}
+outbuf;
+
+/**
+ * Opens path for writing, "-" meaning stdout, with a buffer of cap bytes.
+ *
+ * @param outbuf* out The writer to set up
+ * @param const char* path The file to write to
+ * @param size_t cap The size of the buffer
+ * @param bool unbuffered Write each append immediately, for interactive use
+ *
+ * @return bool true on success, false with errno set on failure
+ */
+bool outbuf_open(outbuf *out, const char *path, size_t cap, bool unbuffered);
+
+/**
+ * Opens a new file in path's directory to be renamed over path by
+ * outbuf_replace, so that a process with path mapped never sees it half
+ * written, and processes writing it at once never mix their output.
+ *
+ * @param outbuf* out The writer to set up
+ * @param const char* path The file to replace
+ * @param size_t cap The size of the buffer
+ *
+ * @return bool true on success, false with errno set on failure
+ */
+bool outbuf_open_replace(outbuf *out, const char *path, size_t cap);
+
+/**
+ * Returns space for len more bytes at the end of the buffer, flushing
+ * first if they would not fit, so callers can produce output in place.
+ * Follow with outbuf_commit. len must not exceed the buffer size.
+ *
+ * @param outbuf* out The writer
+ * @param size_t len The number of bytes wanted
+ *
+ * @return char* Where to put them, NULL if a flush failed
+ */
+char *outbuf_reserve(outbuf *out, size_t len);
+
+/**
+ * Adds len bytes filled in after outbuf_reserve to the buffer.
+ *
+ * @param outbuf* out The writer
+ * @param size_t len The number of bytes filled in
+ *
+ * @return bool false if a write failed
+ */
+bool outbuf_commit(outbuf *out, size_t len);
+
+/**
+ * Appends len bytes. Segments too big to be worth copying are written
+ * together with the buffered bytes using a single writev(2).
+ *
+ * @param outbuf* out The writer
+ * @param const char* data The bytes to append
+ * @param size_t len The number of bytes
+ *
+ * @return bool false if a write failed
+ */
+bool outbuf_append(outbuf *out, const char *data, size_t len);
+
+/**
+ * Writes out everything buffered so far.
+ *
+ * @param outbuf* out The writer
+ *
+ * @return bool false if a write failed
+ */
+bool outbuf_flush(outbuf *out);
+
+/**
+ * Flushes, frees the buffer and closes the file unless it is stdout. A
+ * file opened by outbuf_open_replace is removed, leaving path as it was.
+ *
+ * @param outbuf* out The writer
+ *
+ * @return bool false if the final write or close failed
+ */
+bool outbuf_close(outbuf *out);
+
+/**
+ * Flushes, syncs and closes a file opened by outbuf_open_replace, then
+ * renames it over the path it replaces. On failure the file is removed.
+ *
+ * @param outbuf* out The writer
+ *
+ * @return bool false with errno set if any step failed
+ */
+bool outbuf_replace(outbuf *out);
+
+#endif
@@ -0,0 +1,627 @@
+/**
+ * pdb.c
+ *
+ * Additive disjoint pattern databases for the Game of Fifteen. A table
+ * is built by a breadth first search back from the goal over placements
+ * of its pattern's tiles together with the blank, where moving one of
+ * the pattern's tiles costs a move and moving any other tile costs
+ * nothing. The blank therefore wanders freely through the cells the
+ * pattern leaves it, so a search step floods the blank's whole region
+ * at once and goes on from one of its cells. Placements are ranked
+ * perfectly, as mixed radix numbers whose digits count the free cells
+ * before each tile's, so the search keeps one bit per placement and
+ * blank cell for what it has seen and what it is expanding, and every
+ * step is split across threads by words of the frontier.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "outbuf.h"
+#include "pdb.h"
+
+// most threads a build will start
+#define MAX_THREADS 64
+
+// most placements and blank cells a search keeps bits for, so that no
+// bitmap outgrows a gigabyte
+#define MAX_STATES (1ull << 33)
+
+// a search for one pattern's table
+typedef struct
+{
+    pdb *db;
+    int pattern;
+    int k;                          // tiles in the pattern
+    int n;                          // cells
+    int free_cells;                 // cells the pattern leaves
+    uint8_t goal[PUZZLE_CELLS];     // home of every tile of the pattern
+    uint64_t neighbors[PUZZLE_CELLS];   // cells next to every cell
+    uint64_t *seen;                 // every placement and blank cell seen
+    uint64_t *frontier;             // those reached in cost moves
+    uint64_t *next;                 // those reached in cost + 1 moves
+    uint64_t words;                 // of each bitmap
+    int cost;
+}
+pattern_search;
+
+// the words of the frontier one thread expands
+typedef struct
+{
+    pattern_search *ps;
+    uint64_t begin;
+    uint64_t end;
+    uint64_t added;                 // states put on the next frontier
+}
+search_slice;
+
+/**
+ * Returns seconds on a monotonic clock.
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Returns the number of placements of k tiles in n cells.
+ */
+static uint64_t placements(int n, int k)
+{
+    uint64_t count = 1;
+    for (int i = 0; i < k; i++)
+    {
+        count *= n - i;
+    }
+    return count;
+}
+
+/**
+ * Returns how many cells of a set come before cell.
+ */
+static inline int before(uint64_t set, int cell)
+{
+    return __builtin_popcountll(set & ((1ull << cell) - 1));
+}
+
+/**
+ * Returns the nth cell, from 0, not in a set.
+ */
+static inline int nth_free(uint64_t set, int nth)
+{
+    uint64_t free_set = ~set;
+    for (; nth > 0; nth--)
+    {
+        free_set &= free_set - 1;
+    }
+    return __builtin_ctzll(free_set);
+}
+
+/**
+ * Ranks the cells of k tiles on a board of n cells: every tile's digit
+ * is its cell less the cells taken by the tiles before it.
+ */
+static inline uint64_t rank_cells(const uint8_t cells[], int k, int n)
+{
+    uint64_t used = 0;
+    uint64_t rank = 0;
+    for (int i = 0; i < k; i++)
+    {
+        rank = rank * (n - i) + cells[i] - before(used, cells[i]);
+        used |= 1ull << cells[i];
+    }
+    return rank;
+}
+
+/**
+ * Turns a rank back into the cells of k tiles, returning the set of
+ * cells they take.
+ */
+static uint64_t unrank_cells(uint64_t rank, int k, int n, uint8_t cells[])
+{
+    int digits[PUZZLE_CELLS];
+    for (int i = k - 1; i >= 0; i--)
+    {
+        digits[i] = rank % (n - i);
+        rank /= n - i;
+    }
+    uint64_t used = 0;
+    for (int i = 0; i < k; i++)
+    {
+        cells[i] = nth_free(used, digits[i]);
+        used |= 1ull << cells[i];
+    }
+    return used;
+}
+
+/**
+ * Returns the cells the blank can reach from blank without moving any
+ * tile in occupied.
+ */
+static uint64_t region(const pattern_search *ps, uint64_t occupied, int blank)
+{
+    uint64_t reached = 1ull << blank;
+    uint64_t edge = reached;
+    while (edge != 0)
+    {
+        uint64_t grown = 0;
+        for (uint64_t e = edge; e != 0; e &= e - 1)
+        {
+            grown |= ps->neighbors[__builtin_ctzll(e)];
+        }
+        edge = grown & ~occupied & ~reached;
+        reached |= edge;
+    }
+    return reached;
+}
+
+/**
+ * Sets a bit, returning whether it was set already.
+ */
+static inline bool test_and_set(uint64_t *bits, uint64_t i)
+{
+    uint64_t bit = 1ull << (i % 64);
+    return __atomic_fetch_or(&bits[i / 64], bit, __ATOMIC_RELAXED) & bit;
+}
+
+/**
+ * Records that a placement takes cost moves, unless an earlier step got
+ * there first. Steps write whole nibbles of PDB_UNSET down, and all
+ * threads within a step write the same value, so clearing bits is safe
+ * without a lock.
+ */
+static void record(pattern_search *ps, uint64_t rank, int cost,
+    int manhattan)
+{
+    uint8_t *byte = &ps->db->tables[ps->pattern][rank / 2];
+    int shift = rank % 2 * 4;
+    if ((__atomic_load_n(byte, __ATOMIC_RELAXED) >> shift & 0xf) != PDB_UNSET)
+    {
+        return;
+    }
+    int pairs = (cost - manhattan) / 2;
+    if (pairs > PDB_MAX_PAIRS)
+    {
+        pairs = PDB_MAX_PAIRS;
+    }
+    __atomic_fetch_and(byte, ~((PDB_UNSET & ~pairs) << shift), __ATOMIC_RELAXED);
+}
+
+/**
+ * Marks every cell of the blank's region seen for a placement.
+ */
+static void see_region(pattern_search *ps, uint64_t rank, uint64_t occupied,
+    uint64_t cells)
+{
+    for (; cells != 0; cells &= cells - 1)
+    {
+        int cell = __builtin_ctzll(cells);
+        test_and_set(ps->seen,
+            rank * ps->free_cells + cell - before(occupied, cell));
+    }
+}
+
+/**
+ * Expands one slice of the frontier: from every placement on it, each
+ * tile of the pattern next to the blank's region moves into it.
+ */
+static void *expand(void *arg)
+{
+    search_slice *slice = arg;
+    pattern_search *ps = slice->ps;
+    int k = ps->k, n = ps->n;
+    slice->added = 0;
+
+    for (uint64_t w = slice->begin; w < slice->end; w++)
+    {
+        for (uint64_t word = ps->frontier[w]; word != 0; word &= word - 1)
+        {
+            uint64_t state = w * 64 + __builtin_ctzll(word);
+            uint64_t rank = state / ps->free_cells;
+            uint8_t cells[PUZZLE_CELLS];
+            uint64_t occupied = unrank_cells(rank, k, n, cells);
+            int blank = nth_free(occupied, state % ps->free_cells);
+
+            int tile_at[PUZZLE_CELLS];
+            int manhattan = 0;
+            for (int i = 0; i < k; i++)
+            {
+                tile_at[cells[i]] = i;
+                manhattan += abs(cells[i] / ps->db->d - ps->goal[i] / ps->db->d)
+                    + abs(cells[i] % ps->db->d - ps->goal[i] % ps->db->d);
+            }
+
+            uint64_t reach = region(ps, occupied, blank);
+            for (uint64_t r = reach; r != 0; r &= r - 1)
+            {
+                int to = __builtin_ctzll(r);
+                for (uint64_t m = ps->neighbors[to] & occupied; m != 0; m &= m - 1)
+                {
+                    // the tile slides from from into to, leaving the blank
+                    int from = __builtin_ctzll(m);
+                    int i = tile_at[from];
+                    cells[i] = to;
+                    uint64_t moved = occupied ^ (1ull << from) ^ (1ull << to);
+                    uint64_t next_rank = rank_cells(cells, k, n);
+                    cells[i] = from;
+
+                    uint64_t next_state = next_rank * ps->free_cells + from
+                        - before(moved, from);
+                    if (test_and_set(ps->seen, next_state))
+                    {
+                        continue;
+                    }
+                    see_region(ps, next_rank, moved, region(ps, moved, from));
+                    test_and_set(ps->next, next_state);
+                    slice->added++;
+
+                    int d = ps->db->d;
+                    int goal = ps->goal[i];
+                    record(ps, next_rank, ps->cost + 1, manhattan
+                        - abs(from / d - goal / d) - abs(from % d - goal % d)
+                        + abs(to / d - goal / d) + abs(to % d - goal % d));
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Runs expand over every slice, one thread each, with the calling thread
+ * taking the first. Slices whose thread cannot start run on the caller.
+ */
+static void run_slices(search_slice *slices, int count)
+{
+    pthread_t tids[MAX_THREADS];
+    bool started[MAX_THREADS];
+
+    for (int i = 1; i < count; i++)
+    {
+        started[i] = pthread_create(&tids[i], NULL, expand, &slices[i]) == 0;
+    }
+    expand(&slices[0]);
+    for (int i = 1; i < count; i++)
+    {
+        if (started[i])
+        {
+            pthread_join(tids[i], NULL);
+        }
+        else
+        {
+            expand(&slices[i]);
+        }
+    }
+}
+
+/**
+ * Fills in one pattern's table.
+ */
+static bool build_pattern(pdb *db, int pattern, int threads, bool progress)
+{
+    pattern_search ps = {.db = db, .pattern = pattern, .k = db->size[pattern],
+        .n = db->d * db->d};
+    ps.free_cells = ps.n - ps.k;
+    for (int i = 0; i < ps.k; i++)
+    {
+        ps.goal[i] = db->tiles[pattern][i] - 1;
+    }
+    for (int cell = 0; cell < ps.n; cell++)
+    {
+        int r = cell / db->d, c = cell % db->d;
+        ps.neighbors[cell] = (r > 0 ? 1ull << (cell - db->d) : 0)
+            | (c > 0 ? 1ull << (cell - 1) : 0)
+            | (c < db->d - 1 ? 1ull << (cell + 1) : 0)
+            | (r < db->d - 1 ? 1ull << (cell + db->d) : 0);
+    }
+
+    size_t bytes = (db->entries[pattern] + 1) / 2;
+    ps.words = (db->entries[pattern] * ps.free_cells + 63) / 64;
+    db->tables[pattern] = malloc(bytes);
+    ps.seen = calloc(ps.words, sizeof(uint64_t));
+    ps.frontier = calloc(ps.words, sizeof(uint64_t));
+    ps.next = calloc(ps.words, sizeof(uint64_t));
+    bool ok = db->tables[pattern] != NULL && ps.seen != NULL
+        && ps.frontier != NULL && ps.next != NULL;
+
+    if (ok)
+    {
+        memset(db->tables[pattern], PDB_UNSET << 4 | PDB_UNSET, bytes);
+
+        // the goal, with the blank in the last cell
+        uint64_t rank = rank_cells(ps.goal, ps.k, ps.n);
+        uint64_t occupied = 0;
+        for (int i = 0; i < ps.k; i++)
+        {
+            occupied |= 1ull << ps.goal[i];
+        }
+        int blank = ps.n - 1;
+        see_region(&ps, rank, occupied, region(&ps, occupied, blank));
+        test_and_set(ps.frontier, rank * ps.free_cells + blank
+            - before(occupied, blank));
+        record(&ps, rank, 0, 0);
+
+        search_slice slices[MAX_THREADS];
+        double start = now();
+        for (ps.cost = 0; ; ps.cost++)
+        {
+            for (int t = 0; t < threads; t++)
+            {
+                slices[t] = (search_slice) {.ps = &ps,
+                    .begin = ps.words * t / threads,
+                    .end = ps.words * (t + 1) / threads};
+            }
+            run_slices(slices, threads);
+
+            uint64_t added = 0;
+            for (int t = 0; t < threads; t++)
+            {
+                added += slices[t].added;
+            }
+            if (progress)
+            {
+                fprintf(stderr, "pattern %i: %i moves, %llu placements, "
+                    "%.1f s\n", pattern, ps.cost + 1,
+                    (unsigned long long) added, now() - start);
+            }
+            if (added == 0)
+            {
+                break;
+            }
+
+            uint64_t *done = ps.frontier;
+            ps.frontier = ps.next;
+            ps.next = done;
+            memset(ps.next, 0, ps.words * sizeof(uint64_t));
+        }
+
+        // placements the search never reached promise nothing
+        for (size_t i = 0; i < bytes; i++)
+        {
+            uint8_t byte = db->tables[pattern][i];
+            if ((byte & 0xf) == PDB_UNSET)
+            {
+                byte &= 0xf0;
+            }
+            if (byte >> 4 == PDB_UNSET)
+            {
+                byte &= 0x0f;
+            }
+            db->tables[pattern][i] = byte;
+        }
+    }
+    else
+    {
+        errno = ENOMEM;
+    }
+
+    free(ps.seen);
+    free(ps.frontier);
+    free(ps.next);
+    return ok;
+}
+
+/**
+ * Works out every pattern's tiles and size from pattern_of, returning
+ * false if they make no sense.
+ */
+static bool describe(pdb *db)
+{
+    int n = db->d * db->d;
+    memset(db->size, 0, sizeof(db->size));
+    for (int tile = 1; tile < n; tile++)
+    {
+        int p = db->pattern_of[tile];
+        if (p >= db->pattern_count)
+        {
+            return false;
+        }
+        db->tiles[p][db->size[p]++] = tile;
+    }
+    for (int p = 0; p < db->pattern_count; p++)
+    {
+        if (db->size[p] == 0)
+        {
+            return false;
+        }
+        db->entries[p] = placements(n, db->size[p]);
+        if (db->entries[p] * (n - db->size[p]) > MAX_STATES)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool pdb_split(pdb *db, int d, const char *split)
+{
+    memset(db, 0, sizeof(*db));
+    db->d = d;
+    bool valid = d >= 2 && d <= PDB_MAX_D;
+
+    int tile = 1;
+    for (const char *p = split; valid && *p != '\0'; )
+    {
+        char *end;
+        long size = strtol(p, &end, 10);
+        if (end == p || size < 1 || size > d * d - tile
+            || db->pattern_count == PDB_MAX_PATTERNS)
+        {
+            valid = false;
+            break;
+        }
+        for (int i = 0; i < size; i++)
+        {
+            db->pattern_of[tile++] = db->pattern_count;
+        }
+        db->pattern_count++;
+        p = *end == '-' ? end + 1 : end;
+        valid = *end == '-' ? *p != '\0' : *end == '\0';
+    }
+
+    if (!valid || tile != d * d || !describe(db))
+    {
+        errno = EINVAL;
+        return false;
+    }
+    return true;
+}
+
+bool pdb_build(pdb *db, int threads, bool progress)
+{
+    if (threads < 1)
+    {
+        threads = 1;
+    }
+    if (threads > MAX_THREADS)
+    {
+        threads = MAX_THREADS;
+    }
+    for (int p = 0; p < db->pattern_count; p++)
+    {
+        if (!build_pattern(db, p, threads, progress))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool pdb_write(const pdb *db, const char *path)
+{
+    pdb_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PDB_MAGIC, sizeof(header.magic));
+    header.version = PDB_VERSION;
+    header.d = db->d;
+    header.pattern_count = db->pattern_count;
+    memcpy(header.pattern_of, db->pattern_of, sizeof(header.pattern_of));
+    for (int p = 0; p < db->pattern_count; p++)
+    {
+        header.size += (db->entries[p] + 1) / 2;
+    }
+
+    outbuf out;
+    if (!outbuf_open_replace(&out, path, OUTBUF_SIZE))
+    {
+        return false;
+    }
+    bool ok = outbuf_append(&out, (char *) &header, sizeof(header));
+    for (int p = 0; ok && p < db->pattern_count; p++)
+    {
+        ok = outbuf_append(&out, (char *) db->tables[p],
+            (db->entries[p] + 1) / 2);
+    }
+    if (!ok)
+    {
+        int saved = errno;
+        outbuf_close(&out);
+        errno = saved;
+        return false;
+    }
+    return outbuf_replace(&out);
+}
+
+bool pdb_open(pdb *db, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(pdb_header))
+    {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    else
+    {
+        errno = EINVAL;
+    }
+    int saved = errno;
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        errno = saved;
+        return false;
+    }
+
+    // check the header describes exactly this file
+    const pdb_header *header = map;
+    memset(db, 0, sizeof(*db));
+    bool valid = memcmp(header->magic, PDB_MAGIC, sizeof(header->magic)) == 0
+        && header->version == PDB_VERSION
+        && header->d >= 2 && header->d <= PDB_MAX_D
+        && header->pattern_count >= 1
+        && header->pattern_count <= PDB_MAX_PATTERNS;
+    if (valid)
+    {
+        db->d = header->d;
+        db->pattern_count = header->pattern_count;
+        memcpy(db->pattern_of, header->pattern_of, sizeof(db->pattern_of));
+        valid = describe(db);
+    }
+    uint64_t size = 0;
+    for (int p = 0; valid && p < db->pattern_count; p++)
+    {
+        db->tables[p] = (uint8_t *) (header + 1) + size;
+        size += (db->entries[p] + 1) / 2;
+    }
+    if (!valid || size != header->size
+        || sizeof(*header) + size != (size_t) st.st_size)
+    {
+        munmap(map, st.st_size);
+        memset(db, 0, sizeof(*db));
+        errno = EINVAL;
+        return false;
+    }
+
+    db->map = map;
+    db->map_len = st.st_size;
+    return true;
+}
+
+void pdb_free(pdb *db)
+{
+    if (db->map != NULL)
+    {
+        munmap(db->map, db->map_len);
+    }
+    else
+    {
+        for (int p = 0; p < db->pattern_count; p++)
+        {
+            free(db->tables[p]);
+        }
+    }
+    memset(db, 0, sizeof(*db));
+}
+
+uint64_t pdb_rank(const pdb *db, int pattern, const uint8_t where[])
+{
+    uint8_t cells[PUZZLE_CELLS];
+    for (int i = 0; i < db->size[pattern]; i++)
+    {
+        cells[i] = where[db->tiles[pattern][i]];
+    }
+    return rank_cells(cells, db->size[pattern], db->d * db->d);
+}
+
+int pdb_pairs(const pdb *db, int pattern, uint64_t index)
+{
+    return db->tables[pattern][index / 2] >> (index % 2 * 4) & 0xf;
+}
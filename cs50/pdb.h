@@ -0,0 +1,148 @@
+/**
+ * pdb.h
+ *
+ * Additive disjoint pattern databases for the Game of Fifteen. The tiles
+ * are split into patterns, and every pattern gets a table of the fewest
+ * moves of its own tiles that bring them home from anywhere, whatever
+ * the other tiles do. As no move is counted by two patterns, the tables
+ * add up to an estimate that never overestimates. A table is indexed by
+ * the ranks of its tiles' cells and stores, in four bits, half of what
+ * its tiles need beyond their Manhattan distance, which is always even.
+ * Files are mapped read-only and shared, so there is nothing to build or
+ * read at startup.
+ */
+
+#ifndef PDB_H
+#define PDB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "solver.h"
+
+// identifies a pattern database file, and the layout version this code
+// writes
+#define PDB_MAGIC "FIFTPDB"
+#define PDB_VERSION 1
+
+// most patterns a board is split into
+#define PDB_MAX_PATTERNS 16
+
+// largest board, cells being kept in 64 bit sets
+#define PDB_MAX_D 8
+
+// what a table entry holds while being built, and its largest value
+#define PDB_UNSET 15
+#define PDB_MAX_PAIRS 14
+
+// start of every pattern database file, 128 bytes
+typedef struct
+{
+    char magic[8];                      // PDB_MAGIC
+    uint32_t version;                   // PDB_VERSION
+    uint32_t d;                         // board's dimension
+    uint32_t pattern_count;
+    uint32_t reserved0;
+    uint64_t size;                      // bytes of tables after the header
+    uint8_t pattern_of[PUZZLE_CELLS];   // pattern of every tile
+    uint8_t reserved[15];
+}
+pdb_header;
+
+// a set of pattern databases, built or mapped
+typedef struct pdb
+{
+    int d;
+    int pattern_count;
+    uint8_t pattern_of[PUZZLE_CELLS];   // pattern of every tile
+    int size[PDB_MAX_PATTERNS];         // tiles in every pattern
+    uint8_t tiles[PDB_MAX_PATTERNS][PUZZLE_CELLS];  // in rank order
+    uint64_t entries[PDB_MAX_PATTERNS]; // placements of every pattern
+    uint8_t *tables[PDB_MAX_PATTERNS];  // two entries a byte, low first
+    void *map;                          // the file, if mapped
+    size_t map_len;
+}
+pdb;
+
+/**
+ * Splits the tiles of d x d boards into patterns of consecutive tiles,
+ * e.g. "7-8" for tiles 1 to 7 and 8 to 15, with empty tables.
+ *
+ * @param pdb* db The databases to set up
+ * @param int d The board's dimension
+ * @param const char* split Sizes of the patterns, separated by dashes
+ *
+ * @return bool false with errno set to EINVAL if split does not cover
+ *         the tiles or a pattern would be too big to build
+ */
+bool pdb_split(pdb *db, int d, const char *split);
+
+/**
+ * Fills in every table by a breadth first search back from the goal,
+ * each step split across threads.
+ *
+ * @param pdb* db The databases, as pdb_split left them
+ * @param int threads The number of threads to use
+ * @param bool progress Whether to report every step on stderr
+ *
+ * @return bool false with errno set on failure
+ */
+bool pdb_build(pdb *db, int threads, bool progress);
+
+/**
+ * Writes built databases to a new file and renames it over path, so a
+ * solver with the old file mapped carries on reading it undisturbed.
+ *
+ * @param const pdb* db The databases
+ * @param const char* path The file to create or replace
+ *
+ * @return bool false with errno set on failure
+ */
+bool pdb_write(const pdb *db, const char *path);
+
+/**
+ * Maps the databases at path, checking the header against the file's
+ * size.
+ *
+ * @param pdb* db The databases to fill in
+ * @param const char* path The file to map
+ *
+ * @return bool false with errno set on failure, EINVAL if not a pattern
+ *         database
+ */
+bool pdb_open(pdb *db, const char *path);
+
+/**
+ * Unmaps or frees databases.
+ *
+ * @param pdb* db The databases
+ *
+ * @return void
+ */
+void pdb_free(pdb *db);
+
+/**
+ * Returns the index of a pattern's placement in its table.
+ *
+ * @param const pdb* db The databases
+ * @param int pattern The pattern
+ * @param const uint8_t* where The cell of every tile
+ *
+ * @return uint64_t The index
+ */
+uint64_t pdb_rank(const pdb *db, int pattern, const uint8_t where[]);
+
+/**
+ * Returns half the moves a pattern's tiles need beyond their Manhattan
+ * distance from the placement at index in its table.
+ *
+ * @param const pdb* db The databases
+ * @param int pattern The pattern
+ * @param uint64_t index The placement's index
+ *
+ * @return int Pairs of extra moves
+ */
+int pdb_pairs(const pdb *db, int pattern, uint64_t index);
+
+#endif
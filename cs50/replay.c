@@ -0,0 +1,122 @@
+/**
+ * replay.c
+ *
+ * Reads a move log written by fifteen. By default prints every board of
+ * the game, one a line, in the text save() used to log to log.txt, so
+ * tools written for that format keep working. --at prints just the
+ * board after turn TURN, starting from the nearest checkpoint rather
+ * than the first turn. --checkpoints lists every checkpoint's turn and
+ * offset in the file.
+ *
+ * Usage: ./replay LOG [--at TURN | --checkpoints]
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "movelog.h"
+#include "outbuf.h"
+
+/**
+ * Writes a board to the outbuf in state as text.
+ */
+static bool print_board(const puzzle *board, uint64_t turn, void *state)
+{
+    (void) turn;
+    outbuf *out = state;
+    char *text = outbuf_reserve(out, MOVELOG_TEXT_MAX);
+    return text != NULL && outbuf_commit(out, movelog_format(board, text));
+}
+
+int main(int argc, char *argv[])
+{
+    bool at = false;
+    bool checkpoints = false;
+    uint64_t turn = 0;
+
+    // parse command-line args
+    bool usage = argc >= 2;
+    for (int i = 2; i < argc && usage; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--at") == 0)
+        {
+            at = true;
+            turn = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--checkpoints") == 0)
+        {
+            checkpoints = true;
+        }
+        else
+        {
+            usage = false;
+        }
+    }
+    if (!usage || (at && checkpoints))
+    {
+        printf("Usage: ./replay LOG [--at TURN | --checkpoints]\n");
+        return 1;
+    }
+
+    movelog_reader r;
+    if (!movelog_open(&r, argv[1]))
+    {
+        printf("Error! %s\n", strerror(errno));
+        return 1;
+    }
+    if (at && turn > r.turns)
+    {
+        printf("Error! %s has %llu turns.\n", argv[1],
+            (unsigned long long) r.turns);
+        movelog_close(&r);
+        return 1;
+    }
+
+    outbuf out;
+    if (!outbuf_open(&out, "-", OUTBUF_SIZE, false))
+    {
+        printf("Error! %s\n", strerror(errno));
+        movelog_close(&r);
+        return 1;
+    }
+
+    bool ok = true;
+    if (checkpoints)
+    {
+        for (size_t i = 0; ok && i < r.checkpoint_count; i++)
+        {
+            char line[64];
+            int len = snprintf(line, sizeof(line), "%llu %zu\n",
+                (unsigned long long) r.checkpoints[i].turn,
+                r.checkpoints[i].offset);
+            ok = outbuf_append(&out, line, len);
+        }
+    }
+    else if (at)
+    {
+        ok = movelog_replay(&r, turn, turn, print_board, &out);
+    }
+    else
+    {
+        ok = movelog_replay(&r, 0, r.turns, print_board, &out);
+    }
+
+    int saved = errno;
+    if (!outbuf_close(&out) && ok)
+    {
+        ok = false;
+        saved = errno;
+    }
+    movelog_close(&r);
+    if (!ok)
+    {
+        printf("Error! %s\n", strerror(saved));
+        return 1;
+    }
+    return 0;
+}
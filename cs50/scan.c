@@ -0,0 +1,387 @@
+/**
+ * scan.c
+ *
+ * Linear search of an unsorted haystack. Sorting costs about the same
+ * per value whatever the size of the haystack, as does a scan, so the
+ * break-even point is a number of queries: the ratio of the two costs,
+ * which scan_crossover() measures rather than guesses. The ratio does
+ * change where sort() goes over to threads and the haystack no longer
+ * fits in cache, so it is measured on either side of that, and kept in
+ * a file so that later runs need not measure it again.
+ */
+
+#define _GNU_SOURCE
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "helpers.h"
+#include "outbuf.h"
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+// haystacks this small are sorted, it costs next to nothing
+#define SCAN_MIN 64
+
+// values scan_crossover times for haystacks sorted on one thread, and
+// for those sort() splits across threads, and the runs it takes the best
+// of; the second matches where helpers.c goes over to threads
+#define CALIBRATE_SIZE (1 << 16)
+#define CALIBRATE_LARGE (1 << 20)
+#define CALIBRATE_RUNS 5
+
+// crossovers are kept in DIR/find-crossover-THREADSxVALUES, DIR being
+// $XDG_CACHE_HOME or else $HOME/.cache, as a line of the layout version,
+// a tag for the machine and build that measured it, and the crossover
+#define CACHE_NAME "find-crossover"
+#define CACHE_VERSION 2
+
+// most queries a crossover may be, so that no measurement gone wrong,
+// or file gone wrong, has find scan a haystack without end
+#define CROSSOVER_MAX 4096
+
+/**
+ * Scalar kernel, the fallback and the tail of the others.
+ */
+static bool scan_scalar(const int values[], size_t n, int value)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        if (values[i] == value)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef SCAN_X86
+
+/**
+ * SSE2 kernel, 16 values per iteration.
+ */
+__attribute__((target("sse2")))
+static bool scan_sse2(const int values[], size_t n, int value)
+{
+    const __m128i needle = _mm_set1_epi32(value);
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        const __m128i *v = (const __m128i *) (values + i);
+        __m128i a = _mm_cmpeq_epi32(_mm_loadu_si128(v), needle);
+        __m128i b = _mm_cmpeq_epi32(_mm_loadu_si128(v + 1), needle);
+        __m128i c = _mm_cmpeq_epi32(_mm_loadu_si128(v + 2), needle);
+        __m128i d = _mm_cmpeq_epi32(_mm_loadu_si128(v + 3), needle);
+        __m128i any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+        if (_mm_movemask_epi8(any) != 0)
+        {
+            return true;
+        }
+    }
+
+    return scan_scalar(values + i, n - i, value);
+}
+
+/**
+ * AVX2 kernel, 32 values per iteration.
+ */
+__attribute__((target("avx2")))
+static bool scan_avx2(const int values[], size_t n, int value)
+{
+    const __m256i needle = _mm256_set1_epi32(value);
+
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        const __m256i *v = (const __m256i *) (values + i);
+        __m256i a = _mm256_cmpeq_epi32(_mm256_loadu_si256(v), needle);
+        __m256i b = _mm256_cmpeq_epi32(_mm256_loadu_si256(v + 1), needle);
+        __m256i c = _mm256_cmpeq_epi32(_mm256_loadu_si256(v + 2), needle);
+        __m256i d = _mm256_cmpeq_epi32(_mm256_loadu_si256(v + 3), needle);
+        __m256i any = _mm256_or_si256(_mm256_or_si256(a, b),
+            _mm256_or_si256(c, d));
+        if (!_mm256_testz_si256(any, any))
+        {
+            return true;
+        }
+    }
+
+    return scan_sse2(values + i, n - i, value);
+}
+
+#endif
+
+// kernel picked for this cpu, resolved once, by whichever thread calls
+// first
+typedef bool (*scan_kernel)(const int *, size_t, int);
+static scan_kernel kernel = NULL;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Picks the widest kernel the running cpu supports.
+ */
+static void pick_kernel(void)
+{
+    kernel = scan_scalar;
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        kernel = scan_avx2;
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        kernel = scan_sse2;
+    }
+#endif
+}
+
+bool scan_contains(const int values[], size_t n, int value)
+{
+    pthread_once(&kernel_once, pick_kernel);
+    return kernel(values, n, value);
+}
+
+/**
+ * Returns the time since some fixed point, in seconds.
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Times sorting size values on threads threads against scanning them,
+ * returning the crossover, or 0 if out of memory.
+ */
+static size_t measure(int size, int threads)
+{
+    int *sample = malloc(2 * (size_t) size * sizeof(int));
+    if (sample == NULL)
+    {
+        return 0;
+    }
+    int *copy = sample + size;
+
+    // random non-negative values, so -1 is never found and scans run to
+    // the end
+    uint32_t x = 2463534242u;
+    for (int i = 0; i < size; i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        sample[i] = x >> 1;
+    }
+
+    double sort_time = 1e9;
+    double scan_time = 1e9;
+    volatile bool found = false;
+    for (int run = 0; run < CALIBRATE_RUNS; run++)
+    {
+        memcpy(copy, sample, size * sizeof(int));
+        double start = now();
+        sort_radix(copy, size, threads);
+        double sorted = now();
+        found = scan_contains(sample, size, -1) || found;
+        double scanned = now();
+
+        sort_time = sorted - start < sort_time ? sorted - start : sort_time;
+        scan_time = scanned - sorted < scan_time ? scanned - sorted : scan_time;
+    }
+    free(sample);
+
+    size_t crossover = scan_time > 0 ? sort_time / scan_time : 1;
+    if (crossover > CROSSOVER_MAX)
+    {
+        crossover = CROSSOVER_MAX;
+    }
+    return crossover < 1 ? 1 : crossover;
+}
+
+/**
+ * Folds a string into a running FNV-1a hash.
+ */
+static uint64_t hash_string(uint64_t hash, const char *s)
+{
+    for (; *s != '\0'; s++)
+    {
+        hash = (hash ^ (unsigned char) *s) * 1099511628211ull;
+    }
+    return (hash ^ 0xff) * 1099511628211ull;
+}
+
+/**
+ * Returns a tag for what a crossover depends on: this build of find, the
+ * kernel, and the cpu's model and count, so that a crossover measured
+ * under any other is measured again.
+ */
+static uint64_t machine_tag(void)
+{
+    uint64_t tag = hash_string(14695981039346656037ull, __DATE__ " " __TIME__);
+
+    struct utsname name;
+    if (uname(&name) == 0)
+    {
+        tag = hash_string(tag, name.release);
+        tag = hash_string(tag, name.machine);
+    }
+
+    FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+    if (cpuinfo != NULL)
+    {
+        char line[256];
+        while (fgets(line, sizeof(line), cpuinfo) != NULL)
+        {
+            if (strncmp(line, "model name", 10) == 0)
+            {
+                tag = hash_string(tag, line);
+                break;
+            }
+        }
+        fclose(cpuinfo);
+    }
+
+    char cpus[32];
+    snprintf(cpus, sizeof(cpus), "%ld", sysconf(_SC_NPROCESSORS_ONLN));
+    return hash_string(tag, cpus);
+}
+
+/**
+ * Writes where the crossover measured on size values and threads threads
+ * is kept to path, making its directory if need be. Returns false if
+ * there is nowhere to keep it.
+ */
+static bool cache_path(char path[], size_t len, int size, int threads)
+{
+    const char *cache = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char dir[PATH_MAX];
+    int n;
+    if (cache != NULL && cache[0] != '\0')
+    {
+        n = snprintf(dir, sizeof(dir), "%s", cache);
+    }
+    else if (home != NULL && home[0] != '\0')
+    {
+        n = snprintf(dir, sizeof(dir), "%s/.cache", home);
+    }
+    else
+    {
+        return false;
+    }
+    if (n < 0 || (size_t) n >= sizeof(dir))
+    {
+        return false;
+    }
+    mkdir(dir, 0755);
+
+    n = snprintf(path, len, "%s/%s-%dx%d", dir, CACHE_NAME, threads, size);
+    return n >= 0 && (size_t) n < len;
+}
+
+/**
+ * Returns the crossover kept at path, 0 if there is none, or it was kept
+ * by another layout, machine or build, or is out of range.
+ */
+static size_t read_cached(const char *path, uint64_t tag)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return 0;
+    }
+    int version;
+    unsigned long long kept_tag;
+    size_t crossover;
+    if (fscanf(file, "%d %llx %zu", &version, &kept_tag, &crossover) != 3
+        || version != CACHE_VERSION || kept_tag != tag
+        || crossover < 1 || crossover > CROSSOVER_MAX)
+    {
+        crossover = 0;
+    }
+    fclose(file);
+    return crossover;
+}
+
+/**
+ * Keeps a crossover at path, replacing the file whole so that runs
+ * reading it at once never see it part written. Failing is harmless,
+ * the next run measures again.
+ */
+static void write_cached(const char *path, uint64_t tag, size_t crossover)
+{
+    outbuf out;
+    char line[64];
+    int len = snprintf(line, sizeof(line), "%d %016llx %zu\n", CACHE_VERSION,
+        (unsigned long long) tag, crossover);
+    if (!outbuf_open_replace(&out, path, sizeof(line)))
+    {
+        return;
+    }
+    if (outbuf_append(&out, line, len))
+    {
+        outbuf_replace(&out);
+    }
+    else
+    {
+        outbuf_close(&out);
+    }
+}
+
+size_t scan_crossover(size_t n)
+{
+    // measured once a process on either side of sort()'s threading
+    // cutoff; threads asking at once may both measure, but never tear it
+    static size_t crossovers[2] = {0, 0};
+    bool large = n >= CALIBRATE_LARGE;
+    size_t known = __atomic_load_n(&crossovers[large], __ATOMIC_RELAXED);
+    if (known > 0)
+    {
+        return known;
+    }
+
+    // time sort() as it will run on n values: on as many threads, and on
+    // enough values to be out of cache when they are
+    int size = large ? CALIBRATE_LARGE : CALIBRATE_SIZE;
+    int threads = sort_threads(n > INT_MAX ? INT_MAX : n);
+
+    char path[PATH_MAX];
+    bool cacheable = cache_path(path, sizeof(path), size, threads);
+    uint64_t tag = cacheable ? machine_tag() : 0;
+    size_t crossover = cacheable ? read_cached(path, tag) : 0;
+    if (crossover == 0)
+    {
+        crossover = measure(size, threads);
+        if (crossover == 0)
+        {
+            return 1;
+        }
+        if (cacheable)
+        {
+            write_cached(path, tag, crossover);
+        }
+    }
+    __atomic_store_n(&crossovers[large], crossover, __ATOMIC_RELAXED);
+    return crossover;
+}
+
+bool scan_preferred(size_t n, size_t queries)
+{
+    return n >= SCAN_MIN && queries < scan_crossover(n);
+}
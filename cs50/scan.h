@@ -0,0 +1,52 @@
+/**
+ * scan.h
+ *
+ * Linear search of an unsorted haystack, for when there are too few
+ * needles to pay for sorting it.
+ */
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Returns true if value is among the n values, else false, comparing as
+ * many values at once as the running cpu allows and stopping at the
+ * first match.
+ *
+ * @param const int* values The values, in any order
+ * @param size_t n The number of values
+ * @param int value The value to look for
+ *
+ * @return bool Whether it was found
+ */
+bool scan_contains(const int values[], size_t n, int value);
+
+/**
+ * Returns the number of queries below which scanning a haystack of n
+ * values for each is faster than sorting it once and searching. Measured
+ * on this machine by timing sort(), on the threads it would use for n
+ * values, against a scan on a sample, then kept in a file under
+ * $XDG_CACHE_HOME or $HOME/.cache for later runs of the same build on
+ * the same machine, and measured again for any other.
+ *
+ * @param size_t n The size of the haystack
+ *
+ * @return size_t The crossover, at least 1
+ */
+size_t scan_crossover(size_t n);
+
+/**
+ * Returns true if queries lookups in a haystack of n values are best
+ * answered by scanning it, else false.
+ *
+ * @param size_t n The size of the haystack
+ * @param size_t queries The number of lookups
+ *
+ * @return bool Whether to scan instead of sorting
+ */
+bool scan_preferred(size_t n, size_t queries);
+
+#endif
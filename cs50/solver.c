@@ -0,0 +1,800 @@
+/**
+ * solver.c
+ *
+ * Optimal solver for the Game of Fifteen by IDA*: depth first searches
+ * bounded by moves made plus an estimate of moves left, the bound rising
+ * to the smallest total that overran it until a search reaches the goal.
+ * The estimate is the Manhattan distance plus linear conflicts, two
+ * tiles in their goal row (or column) but in each other's way costing
+ * two moves more. Both are kept up to date as tiles move rather than
+ * recounted: a move changes one tile's distance, and the conflicts of
+ * the two columns a tile slides between, or the two rows. Pattern
+ * databases, when given, are looked up again only for the pattern of
+ * the tile that moved.
+ *
+ * The parallel search expands the root breadth first into a few thousand
+ * boards, then runs every round of IDA* over them on several threads.
+ * Each thread owns a deque of boards, taking from its bottom, and steals
+ * from the top of the others' when its own runs dry. The first thread to
+ * reach the goal raises a shared flag that stops the rest; as every
+ * total below the round's bound was ruled out in earlier rounds, any
+ * solution a round finds is as short as can be.
+ */
+
+#define _GNU_SOURCE
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pdb.h"
+#include "solver.h"
+
+// what a search returns once it reaches the goal
+#define FOUND -1
+
+// boards the parallel search expands the root into, at least
+#define FRONTIER_SIZE 4096
+
+// deepest the root is expanded, to bound the moves a board keeps
+#define FRONTIER_DEPTH 64
+
+// most threads the parallel search will start
+#define MAX_THREADS 64
+
+// where everything is on boards of one size
+typedef struct
+{
+    int d;
+    uint8_t row[PUZZLE_CELLS];                  // row of every cell
+    uint8_t column[PUZZLE_CELLS];               // column of every cell
+    uint8_t distance[PUZZLE_CELLS][PUZZLE_CELLS];   // of tile from cell
+    uint8_t neighbors[PUZZLE_CELLS][4];         // cells next to every cell
+    uint8_t neighbor_count[PUZZLE_CELLS];
+}
+tables;
+
+// a search in progress
+typedef struct
+{
+    const tables *t;
+    puzzle p;
+    int manhattan;
+    int conflicts;                      // linear conflicts of every line
+    int row_conflicts[PUZZLE_MAX];
+    int column_conflicts[PUZZLE_MAX];
+    const pdb *db;                      // or NULL
+    uint8_t where[PUZZLE_CELLS];        // cell of every tile
+    int pairs;                          // from every pattern's table
+    int pattern_pairs[PDB_MAX_PATTERNS];
+    atomic_bool *stop;                  // set to give up, or NULL
+    unsigned long long nodes;
+    int length;                         // of the path, once found
+    uint8_t path[SOLVE_MAX_MOVES];
+}
+search;
+
+// a board some moves below the root, searched below by one thread
+typedef struct
+{
+    puzzle p;
+    int g;                              // moves from the root
+    int from;                           // cell the blank came from
+    uint8_t path[FRONTIER_DEPTH];
+}
+subproblem;
+
+// boards one thread searches, bottom for itself and top for thieves
+typedef struct
+{
+    pthread_mutex_t lock;
+    int *tasks;
+    int top;
+    int bottom;
+}
+deque;
+
+// a round of the parallel search
+typedef struct
+{
+    const tables *t;
+    const pdb *db;
+    subproblem *frontier;
+    int count;
+    deque deques[MAX_THREADS];
+    int threads;
+    int bound;
+    atomic_int next_bound;              // smallest total over bound
+    atomic_bool found;
+    int length;                         // of the solution, once found
+    uint8_t moves[SOLVE_MAX_MOVES];
+}
+parallel_search;
+
+// one thread of the parallel search
+typedef struct
+{
+    parallel_search *ps;
+    int id;
+    search s;
+    unsigned long long nodes;
+}
+worker;
+
+/**
+ * Returns seconds on a monotonic clock.
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Fills in the tables for d x d boards.
+ */
+static void build_tables(tables *t, int d)
+{
+    memset(t, 0, sizeof(*t));
+    t->d = d;
+    for (int cell = 0; cell < d * d; cell++)
+    {
+        t->row[cell] = cell / d;
+        t->column[cell] = cell % d;
+    }
+    for (int cell = 0; cell < d * d; cell++)
+    {
+        for (int tile = 1; tile < d * d; tile++)
+        {
+            t->distance[tile][cell] =
+                abs(t->row[cell] - t->row[tile - 1]) +
+                abs(t->column[cell] - t->column[tile - 1]);
+        }
+
+        // up, left, right, down
+        int r = t->row[cell], c = t->column[cell];
+        uint8_t *n = t->neighbors[cell];
+        int count = 0;
+        if (r > 0)
+        {
+            n[count++] = cell - d;
+        }
+        if (c > 0)
+        {
+            n[count++] = cell - 1;
+        }
+        if (c < d - 1)
+        {
+            n[count++] = cell + 1;
+        }
+        if (r < d - 1)
+        {
+            n[count++] = cell + d;
+        }
+        t->neighbor_count[cell] = count;
+    }
+}
+
+/**
+ * Returns the linear conflicts of a row, or a column: twice the fewest
+ * of its tiles that must leave it so that those left in their goal line
+ * are in order, which is as many as are not in its longest increasing
+ * run of goal positions.
+ */
+static int line_conflicts(const tables *t, const uint8_t cells[], int line,
+    bool column)
+{
+    int d = t->d;
+    int goals[PUZZLE_MAX];
+    int k = 0;
+    for (int i = 0; i < d; i++)
+    {
+        int cell = column ? i * d + line : line * d + i;
+        int tile = cells[cell];
+        if (tile == 0)
+        {
+            continue;
+        }
+        if (column ? t->column[tile - 1] == line : t->row[tile - 1] == line)
+        {
+            goals[k++] = column ? t->row[tile - 1] : t->column[tile - 1];
+        }
+    }
+    if (k < 2)
+    {
+        return 0;
+    }
+
+    // longest increasing subsequence, quadratic being plenty for nine
+    int longest[PUZZLE_MAX];
+    int best = 0;
+    for (int i = 0; i < k; i++)
+    {
+        longest[i] = 1;
+        for (int j = 0; j < i; j++)
+        {
+            if (goals[j] < goals[i] && longest[j] + 1 > longest[i])
+            {
+                longest[i] = longest[j] + 1;
+            }
+        }
+        if (longest[i] > best)
+        {
+            best = longest[i];
+        }
+    }
+    return 2 * (k - best);
+}
+
+/**
+ * Starts a search from p, counting its distance and conflicts and
+ * looking up every pattern.
+ */
+static void start_search(search *s, const tables *t, const pdb *db,
+    const puzzle *p)
+{
+    s->t = t;
+    s->p = *p;
+    s->db = db;
+    s->stop = NULL;
+    s->nodes = 0;
+    s->manhattan = 0;
+    for (int cell = 0; cell < t->d * t->d; cell++)
+    {
+        if (p->cells[cell] != 0)
+        {
+            s->manhattan += t->distance[p->cells[cell]][cell];
+        }
+    }
+    s->conflicts = 0;
+    for (int line = 0; line < t->d; line++)
+    {
+        s->row_conflicts[line] = line_conflicts(t, p->cells, line, false);
+        s->column_conflicts[line] = line_conflicts(t, p->cells, line, true);
+        s->conflicts += s->row_conflicts[line] + s->column_conflicts[line];
+    }
+    for (int cell = 0; cell < t->d * t->d; cell++)
+    {
+        s->where[p->cells[cell]] = cell;
+    }
+    s->pairs = 0;
+    for (int i = 0; db != NULL && i < db->pattern_count; i++)
+    {
+        s->pattern_pairs[i] = pdb_pairs(db, i, pdb_rank(db, i, s->where));
+        s->pairs += s->pattern_pairs[i];
+    }
+}
+
+/**
+ * Returns the estimate of moves left: the Manhattan distance plus
+ * whichever of the conflicts and the patterns' extra moves is more.
+ */
+static inline int estimate(const search *s)
+{
+    int extra = 2 * s->pairs;
+    return s->manhattan + (s->conflicts > extra ? s->conflicts : extra);
+}
+
+/**
+ * Recounts the conflicts of one row or column after a move.
+ */
+static inline void update_line(search *s, int line, bool column)
+{
+    int *counted = column ? &s->column_conflicts[line] :
+        &s->row_conflicts[line];
+    int conflicts = line_conflicts(s->t, s->p.cells, line, column);
+    s->conflicts += conflicts - *counted;
+    *counted = conflicts;
+}
+
+/**
+ * Searches below a board g moves from the start, never moving the blank
+ * back to from, which would undo the last move. Returns FOUND, with the
+ * moves in path, or the smallest total over bound.
+ */
+static int dfs(search *s, int g, int bound, int from)
+{
+    s->nodes++;
+    if (s->stop != NULL && atomic_load_explicit(s->stop, memory_order_relaxed))
+    {
+        return INT_MAX;
+    }
+    int h = estimate(s);
+    if (g + h > bound)
+    {
+        return g + h;
+    }
+    if (s->manhattan == 0)
+    {
+        s->length = g;
+        return FOUND;
+    }
+    if (g == SOLVE_MAX_MOVES)
+    {
+        return INT_MAX;
+    }
+
+    const tables *t = s->t;
+    int blank = s->p.blank;
+    int min = INT_MAX;
+    for (int i = 0; i < t->neighbor_count[blank]; i++)
+    {
+        int cell = t->neighbors[blank][i];
+        if (cell == from)
+        {
+            continue;
+        }
+
+        // slide the tile into the blank
+        int tile = s->p.cells[cell];
+        s->p.cells[blank] = tile;
+        s->p.cells[cell] = 0;
+        s->p.blank = cell;
+        s->manhattan += t->distance[tile][blank] - t->distance[tile][cell];
+        int saved_conflicts = s->conflicts;
+        bool across = t->row[cell] == t->row[blank];
+        int a = across ? t->column[cell] : t->row[cell];
+        int b = across ? t->column[blank] : t->row[blank];
+        int *lines = across ? s->column_conflicts : s->row_conflicts;
+        int saved_a = lines[a], saved_b = lines[b];
+        update_line(s, a, across);
+        update_line(s, b, across);
+        s->where[tile] = blank;
+        int pattern = 0, saved_pairs = 0;
+        if (s->db != NULL)
+        {
+            pattern = s->db->pattern_of[tile];
+            saved_pairs = s->pattern_pairs[pattern];
+            s->pattern_pairs[pattern] = pdb_pairs(s->db, pattern,
+                pdb_rank(s->db, pattern, s->where));
+            s->pairs += s->pattern_pairs[pattern] - saved_pairs;
+        }
+        s->path[g] = tile;
+
+        int result = dfs(s, g + 1, bound, blank);
+
+        // and back
+        s->p.cells[cell] = tile;
+        s->p.cells[blank] = 0;
+        s->p.blank = blank;
+        s->manhattan -= t->distance[tile][blank] - t->distance[tile][cell];
+        s->conflicts = saved_conflicts;
+        lines[a] = saved_a;
+        lines[b] = saved_b;
+        s->where[tile] = cell;
+        if (s->db != NULL)
+        {
+            s->pairs += saved_pairs - s->pattern_pairs[pattern];
+            s->pattern_pairs[pattern] = saved_pairs;
+        }
+
+        if (result == FOUND)
+        {
+            return FOUND;
+        }
+        if (result < min)
+        {
+            min = result;
+        }
+    }
+    return min;
+}
+
+/**
+ * Returns true if every tile of p is home.
+ */
+static bool solved(const puzzle *p)
+{
+    for (int cell = 0; cell < p->d * p->d - 1; cell++)
+    {
+        if (p->cells[cell] != cell + 1)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Expands p breadth first, never undoing a move, until a level holds at
+ * least FRONTIER_SIZE boards, and returns that level. If a level holds
+ * the goal, returns it alone with *found set, as nothing is closer.
+ * Returns NULL if out of memory.
+ */
+static subproblem *expand_root(const tables *t, const puzzle *p, int *count,
+    bool *found, unsigned long long *nodes)
+{
+    subproblem *level = malloc(sizeof(subproblem));
+    if (level == NULL)
+    {
+        return NULL;
+    }
+    level[0] = (subproblem) {.p = *p, .g = 0, .from = -1};
+    *count = 1;
+    *found = solved(p);
+
+    for (int depth = 0; !*found && *count < FRONTIER_SIZE
+        && depth < FRONTIER_DEPTH; depth++)
+    {
+        subproblem *next = malloc(4 * *count * sizeof(subproblem));
+        if (next == NULL)
+        {
+            free(level);
+            return NULL;
+        }
+        int n = 0;
+        for (int i = 0; i < *count && !*found; i++)
+        {
+            const subproblem *sub = &level[i];
+            int blank = sub->p.blank;
+            for (int j = 0; j < t->neighbor_count[blank]; j++)
+            {
+                int cell = t->neighbors[blank][j];
+                if (cell == sub->from)
+                {
+                    continue;
+                }
+                subproblem *child = &next[n++];
+                *child = *sub;
+                child->p.cells[blank] = sub->p.cells[cell];
+                child->p.cells[cell] = 0;
+                child->p.blank = cell;
+                child->path[child->g++] = sub->p.cells[cell];
+                child->from = blank;
+                (*nodes)++;
+                if (solved(&child->p))
+                {
+                    next[0] = *child;
+                    n = 1;
+                    *found = true;
+                    break;
+                }
+            }
+        }
+        free(level);
+        level = next;
+        *count = n;
+    }
+    return level;
+}
+
+/**
+ * Takes a board to search: from the bottom of the thread's own deque,
+ * else from the top of another's. Returns false once every deque is
+ * empty, as no round adds boards.
+ */
+static bool take(parallel_search *ps, int id, int *task)
+{
+    for (int i = 0; i < ps->threads; i++)
+    {
+        deque *q = &ps->deques[(id + i) % ps->threads];
+        pthread_mutex_lock(&q->lock);
+        bool taken = q->bottom > q->top;
+        if (taken)
+        {
+            *task = i == 0 ? q->tasks[--q->bottom] : q->tasks[q->top++];
+        }
+        pthread_mutex_unlock(&q->lock);
+        if (taken)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Searches boards of one round until there are none left or some
+ * thread has reached the goal.
+ */
+static void *work(void *arg)
+{
+    worker *w = arg;
+    parallel_search *ps = w->ps;
+    int task;
+    while (!atomic_load(&ps->found) && take(ps, w->id, &task))
+    {
+        const subproblem *sub = &ps->frontier[task];
+        start_search(&w->s, ps->t, ps->db, &sub->p);
+        w->s.stop = &ps->found;
+        memcpy(w->s.path, sub->path, sub->g);
+        int result = dfs(&w->s, sub->g, ps->bound, sub->from);
+        w->nodes += w->s.nodes;
+
+        if (result == FOUND)
+        {
+            bool first = false;
+            if (atomic_compare_exchange_strong(&ps->found, &first, true))
+            {
+                ps->length = w->s.length;
+                memcpy(ps->moves, w->s.path, w->s.length);
+            }
+        }
+        else
+        {
+            int next = atomic_load(&ps->next_bound);
+            while (result < next && !atomic_compare_exchange_weak(
+                &ps->next_bound, &next, result))
+            {
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Runs a round on every worker, one thread each, with the calling thread
+ * taking the first. Workers whose thread cannot start run on the caller.
+ */
+static void run_workers(worker workers[], int count)
+{
+    pthread_t tids[MAX_THREADS];
+    bool started[MAX_THREADS];
+
+    for (int i = 1; i < count; i++)
+    {
+        started[i] = pthread_create(&tids[i], NULL, work, &workers[i]) == 0;
+    }
+    work(&workers[0]);
+    for (int i = 1; i < count; i++)
+    {
+        if (started[i])
+        {
+            pthread_join(tids[i], NULL);
+        }
+        else
+        {
+            work(&workers[i]);
+        }
+    }
+}
+
+/**
+ * Runs IDA* rounds over the frontier in ps until one reaches the goal,
+ * returning the solution's length, or -1.
+ */
+static int search_frontier(parallel_search *ps, worker workers[])
+{
+    // no solution is shorter than the best total on the frontier
+    int bound = INT_MAX;
+    for (int i = 0; i < ps->count; i++)
+    {
+        start_search(&workers[0].s, ps->t, ps->db, &ps->frontier[i].p);
+        int total = ps->frontier[i].g + estimate(&workers[0].s);
+        if (total < bound)
+        {
+            bound = total;
+        }
+    }
+
+    while (bound <= SOLVE_MAX_MOVES)
+    {
+        // deal the boards out round robin
+        for (int t = 0; t < ps->threads; t++)
+        {
+            ps->deques[t].top = 0;
+            ps->deques[t].bottom = 0;
+        }
+        for (int i = 0; i < ps->count; i++)
+        {
+            deque *q = &ps->deques[i % ps->threads];
+            q->tasks[q->bottom++] = i;
+        }
+        ps->bound = bound;
+        atomic_store(&ps->next_bound, INT_MAX);
+
+        run_workers(workers, ps->threads);
+        if (atomic_load(&ps->found))
+        {
+            return ps->length;
+        }
+        bound = atomic_load(&ps->next_bound);
+    }
+    return -1;
+}
+
+bool puzzle_from_board(puzzle *p, int d, const int board[][PUZZLE_MAX],
+    int blank)
+{
+    if (d < 2 || d > PUZZLE_MAX)
+    {
+        return false;
+    }
+    memset(p, 0, sizeof(*p));
+    p->d = d;
+    bool seen[PUZZLE_CELLS] = { false };
+    for (int i = 0; i < d; i++)
+    {
+        for (int j = 0; j < d; j++)
+        {
+            int tile = board[i][j] == blank ? 0 : board[i][j];
+            if (tile < 0 || tile >= d * d || seen[tile])
+            {
+                return false;
+            }
+            seen[tile] = true;
+            p->cells[i * d + j] = tile;
+            if (tile == 0)
+            {
+                p->blank = i * d + j;
+            }
+        }
+    }
+    return true;
+}
+
+bool puzzle_solvable(const puzzle *p)
+{
+    int n = p->d * p->d;
+
+    // parity of the permutation, counting the blank as tile n, by cycles
+    bool visited[PUZZLE_CELLS] = { false };
+    int swaps = 0;
+    for (int cell = 0; cell < n; cell++)
+    {
+        int length = 0;
+        for (int c = cell; !visited[c]; length++)
+        {
+            visited[c] = true;
+            int tile = p->cells[c] == 0 ? n : p->cells[c];
+            c = tile - 1;
+        }
+        if (length > 0)
+        {
+            swaps += length - 1;
+        }
+    }
+
+    int distance = (p->d - 1 - p->blank / p->d) + (p->d - 1 - p->blank % p->d);
+    return swaps % 2 == distance % 2;
+}
+
+int puzzle_estimate(const puzzle *p)
+{
+    tables t;
+    build_tables(&t, p->d);
+    search s;
+    start_search(&s, &t, NULL, p);
+    return estimate(&s);
+}
+
+int solve(const puzzle *p, const pdb *db, uint8_t moves[],
+    solve_stats *stats)
+{
+    double start = now();
+    int length = -1;
+    unsigned long long nodes = 0;
+
+    if (db != NULL && db->d != p->d)
+    {
+        db = NULL;
+    }
+    if (puzzle_solvable(p))
+    {
+        tables *t = malloc(sizeof(tables));
+        search *s = malloc(sizeof(search));
+        if (t != NULL && s != NULL)
+        {
+            build_tables(t, p->d);
+            start_search(s, t, db, p);
+            int bound = estimate(s);
+            while (bound <= SOLVE_MAX_MOVES)
+            {
+                int result = dfs(s, 0, bound, -1);
+                if (result == FOUND)
+                {
+                    length = s->length;
+                    break;
+                }
+                bound = result;
+            }
+            nodes = s->nodes;
+            if (length >= 0)
+            {
+                memcpy(moves, s->path, length);
+            }
+        }
+        free(t);
+        free(s);
+    }
+
+    if (stats != NULL)
+    {
+        stats->nodes = nodes;
+        stats->seconds = now() - start;
+    }
+    return length;
+}
+
+int solve_parallel(const puzzle *p, const pdb *db, int threads,
+    uint8_t moves[], solve_stats *stats)
+{
+    if (threads <= 1)
+    {
+        return solve(p, db, moves, stats);
+    }
+    if (threads > MAX_THREADS)
+    {
+        threads = MAX_THREADS;
+    }
+
+    double start = now();
+    int length = -1;
+    unsigned long long nodes = 0;
+
+    if (db != NULL && db->d != p->d)
+    {
+        db = NULL;
+    }
+    tables *t = malloc(sizeof(tables));
+    parallel_search *ps = malloc(sizeof(parallel_search));
+    worker *workers = malloc(threads * sizeof(worker));
+    subproblem *frontier = NULL;
+    int count = 0;
+    bool found = false;
+    if (puzzle_solvable(p) && t != NULL && ps != NULL && workers != NULL)
+    {
+        build_tables(t, p->d);
+        frontier = expand_root(t, p, &count, &found, &nodes);
+    }
+
+    if (frontier != NULL && found)
+    {
+        length = frontier[0].g;
+        memcpy(moves, frontier[0].path, length);
+    }
+    else if (frontier != NULL)
+    {
+        *ps = (parallel_search) {.t = t, .db = db, .frontier = frontier,
+            .count = count, .threads = threads};
+        atomic_init(&ps->found, false);
+        atomic_init(&ps->next_bound, INT_MAX);
+        int ready = 0;
+        for (; ready < threads; ready++)
+        {
+            deque *q = &ps->deques[ready];
+            q->tasks = malloc(count * sizeof(int));
+            if (q->tasks == NULL)
+            {
+                break;
+            }
+            pthread_mutex_init(&q->lock, NULL);
+            workers[ready].ps = ps;
+            workers[ready].id = ready;
+            workers[ready].nodes = 0;
+        }
+
+        if (ready == threads)
+        {
+            length = search_frontier(ps, workers);
+            if (length >= 0)
+            {
+                memcpy(moves, ps->moves, length);
+            }
+            for (int i = 0; i < threads; i++)
+            {
+                nodes += workers[i].nodes;
+            }
+        }
+        for (int i = 0; i < ready; i++)
+        {
+            free(ps->deques[i].tasks);
+            pthread_mutex_destroy(&ps->deques[i].lock);
+        }
+    }
+
+    free(frontier);
+    free(workers);
+    free(ps);
+    free(t);
+    if (stats != NULL)
+    {
+        stats->nodes = nodes;
+        stats->seconds = now() - start;
+    }
+    return length;
+}
@@ -0,0 +1,110 @@
+/**
+ * solver.h
+ *
+ * Optimal solver for the Game of Fifteen, on a compact copy of the
+ * board rather than fifteen.c's globals.
+ */
+
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// largest board, as in fifteen.c
+#define PUZZLE_MAX 9
+#define PUZZLE_CELLS (PUZZLE_MAX * PUZZLE_MAX)
+
+// longest solution solve will look for
+#define SOLVE_MAX_MOVES 1024
+
+// a board, tile t belonging in cell t - 1 and the blank in the last cell
+typedef struct
+{
+    uint8_t d;
+    uint8_t blank;                  // cell of the blank
+    uint8_t cells[PUZZLE_CELLS];    // tile in each cell, 0 for the blank
+}
+puzzle;
+
+// pattern databases, see pdb.h
+struct pdb;
+
+// what a search cost
+typedef struct
+{
+    unsigned long long nodes;       // boards expanded
+    double seconds;
+}
+solve_stats;
+
+/**
+ * Copies a d x d board in fifteen.c's layout, board[i][j] being row i
+ * and column j, into a puzzle.
+ *
+ * @param puzzle* p The puzzle to fill in
+ * @param int d The board's dimension
+ * @param const int board The board
+ * @param int blank The value of the blank in board
+ *
+ * @return bool false if board does not hold every tile exactly once
+ */
+bool puzzle_from_board(puzzle *p, int d, const int board[][PUZZLE_MAX],
+    int blank);
+
+/**
+ * Returns true if the goal can be reached from p, else false: exactly
+ * when the parity of the permutation matches that of the distance the
+ * blank is from its goal, as every move changes both.
+ *
+ * @param const puzzle* p The puzzle
+ *
+ * @return bool Whether it can be solved
+ */
+bool puzzle_solvable(const puzzle *p);
+
+/**
+ * Returns the Manhattan distance plus linear conflict estimate of the
+ * moves left to solve p, which never overestimates.
+ *
+ * @param const puzzle* p The puzzle
+ *
+ * @return int The estimate
+ */
+int puzzle_estimate(const puzzle *p);
+
+/**
+ * Finds a shortest solution by IDA*, writing the tiles to move, in
+ * order, to moves. With pattern databases for the board's size, the
+ * estimate is whichever of their total and linear conflicts adds more
+ * to the Manhattan distance.
+ *
+ * @param const puzzle* p The puzzle to solve
+ * @param const struct pdb* db Pattern databases, or NULL
+ * @param uint8_t* moves Room for SOLVE_MAX_MOVES tiles
+ * @param solve_stats* stats Filled in with the cost of the search
+ *
+ * @return int The number of moves, -1 if there is no solution within
+ *         SOLVE_MAX_MOVES
+ */
+int solve(const puzzle *p, const struct pdb *db, uint8_t moves[],
+    solve_stats *stats);
+
+/**
+ * Finds a shortest solution like solve, but with the root expanded into
+ * a few thousand boards that threads search, stealing each other's when
+ * they run out.
+ *
+ * @param const puzzle* p The puzzle to solve
+ * @param const struct pdb* db Pattern databases, or NULL
+ * @param int threads The number of threads to use, 1 for solve itself
+ * @param uint8_t* moves Room for SOLVE_MAX_MOVES tiles
+ * @param solve_stats* stats Filled in with the cost of the search
+ *
+ * @return int The number of moves, -1 if there is no solution within
+ *         SOLVE_MAX_MOVES or memory ran out
+ */
+int solve_parallel(const puzzle *p, const struct pdb *db, int threads,
+    uint8_t moves[], solve_stats *stats);
+
+#endif
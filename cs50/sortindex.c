@@ -0,0 +1,242 @@
+/**
+ * sortindex.c
+ *
+ * On-disk sorted index for find.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sortindex.h"
+
+// FNV-1a 64, applied a value at a time
+#define CHECKSUM_SEED 14695981039346656037ull
+#define CHECKSUM_PRIME 1099511628211ull
+
+/**
+ * Folds n values into a running checksum.
+ */
+static uint64_t checksum(uint64_t sum, const int values[], size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        sum = (sum ^ (uint32_t) values[i]) * CHECKSUM_PRIME;
+    }
+    return sum;
+}
+
+bool sortindex_begin(sortindex_writer *w, const char *path,
+    size_t fence_stride)
+{
+    *w = (sortindex_writer) {.checksum = CHECKSUM_SEED,
+        .fence_stride = fence_stride};
+    if (!outbuf_open_replace(&w->out, path, OUTBUF_SIZE))
+    {
+        return false;
+    }
+
+    // room for the header, written for real at the end
+    sortindex_header header;
+    memset(&header, 0, sizeof(header));
+    if (!outbuf_append(&w->out, (char *) &header, sizeof(header)))
+    {
+        sortindex_abort(w);
+        return false;
+    }
+    return true;
+}
+
+bool sortindex_append(sortindex_writer *w, const int values[], size_t n)
+{
+    // remember every fence_stride'th value
+    if (w->fence_stride > 0)
+    {
+        size_t first = (w->fence_stride - w->count % w->fence_stride)
+            % w->fence_stride;
+        for (size_t i = first; i < n; i += w->fence_stride)
+        {
+            if (w->fence_count == w->fence_cap)
+            {
+                size_t cap = w->fence_cap ? w->fence_cap * 2 : 1024;
+                int *fences = realloc(w->fences, cap * sizeof(int));
+                if (fences == NULL)
+                {
+                    return false;
+                }
+                w->fences = fences;
+                w->fence_cap = cap;
+            }
+            w->fences[w->fence_count++] = values[i];
+        }
+    }
+
+    w->count += n;
+    w->checksum = checksum(w->checksum, values, n);
+    return outbuf_append(&w->out, (const char *) values, n * sizeof(int));
+}
+
+bool sortindex_finish(sortindex_writer *w)
+{
+    sortindex_header header = {SORTINDEX_MAGIC, SORTINDEX_VERSION,
+        w->fence_stride, w->count, w->fence_count,
+        checksum(w->checksum, w->fences, w->fence_count), {0}};
+
+    bool ok = outbuf_append(&w->out, (const char *) w->fences,
+        w->fence_count * sizeof(int)) && outbuf_flush(&w->out)
+        && pwrite(w->out.fd, &header, sizeof(header), 0) == sizeof(header);
+
+    if (!ok)
+    {
+        sortindex_abort(w);
+        return false;
+    }
+    free(w->fences);
+    w->fences = NULL;
+    return outbuf_replace(&w->out);
+}
+
+void sortindex_abort(sortindex_writer *w)
+{
+    int saved = errno;
+    free(w->fences);
+    w->fences = NULL;
+    outbuf_close(&w->out);
+    errno = saved;
+}
+
+bool sortindex_write(const char *path, const int sorted[], size_t n)
+{
+    sortindex_writer w;
+    if (!sortindex_begin(&w, path, SORTINDEX_STRIDE))
+    {
+        return false;
+    }
+    if (!sortindex_append(&w, sorted, n))
+    {
+        sortindex_abort(&w);
+        return false;
+    }
+    return sortindex_finish(&w);
+}
+
+bool sortindex_open(sortindex *index, const char *path, bool verify)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(sortindex_header))
+    {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    else
+    {
+        errno = EINVAL;
+    }
+    int saved = errno;
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        errno = saved;
+        return false;
+    }
+
+    // check the header describes exactly this file
+    const sortindex_header *header = map;
+    const int *values = (const int *) (header + 1);
+    bool valid = memcmp(header->magic, SORTINDEX_MAGIC, sizeof(header->magic)) == 0
+        && header->version == SORTINDEX_VERSION
+        && header->count <= (st.st_size - sizeof(*header)) / sizeof(int)
+        && header->fence_count <= (st.st_size - sizeof(*header)) / sizeof(int)
+        && sizeof(*header) + (header->count + header->fence_count) * sizeof(int)
+            == (size_t) st.st_size
+        && (header->fence_stride == 0
+            ? header->fence_count == 0
+            : header->fence_count
+                == (header->count + header->fence_stride - 1) / header->fence_stride);
+
+    if (valid && verify)
+    {
+        valid = checksum(CHECKSUM_SEED, values,
+            header->count + header->fence_count) == header->checksum;
+    }
+    if (!valid)
+    {
+        munmap(map, st.st_size);
+        errno = EINVAL;
+        return false;
+    }
+
+    *index = (sortindex) {
+        .values = values,
+        .count = header->count,
+        .fences = values + header->count,
+        .fence_count = header->fence_count,
+        .fence_stride = header->fence_stride,
+        .checksum = header->checksum,
+        .map = map,
+        .map_len = st.st_size,
+    };
+    return true;
+}
+
+void sortindex_close(sortindex *index)
+{
+    munmap(index->map, index->map_len);
+    index->map = NULL;
+}
+
+/**
+ * Returns the number of values in the n at values less than or equal
+ * to value.
+ */
+static size_t upper_bound(const int values[], size_t n, int value)
+{
+    size_t low = 0;
+    while (n > 0)
+    {
+        size_t half = n / 2;
+        if (values[low + half] <= value)
+        {
+            low += half + 1;
+            n -= half + 1;
+        }
+        else
+        {
+            n = half;
+        }
+    }
+    return low;
+}
+
+bool sortindex_search(const sortindex *index, int value)
+{
+    size_t begin = 0;
+    size_t end = index->count;
+
+    // the last fence not above value starts the only block it can be in
+    if (index->fence_count > 0)
+    {
+        size_t fence = upper_bound(index->fences, index->fence_count, value);
+        if (fence == 0)
+        {
+            return false;
+        }
+        begin = (fence - 1) * index->fence_stride;
+        end = begin + index->fence_stride < end ? begin + index->fence_stride : end;
+    }
+
+    size_t i = upper_bound(index->values + begin, end - begin, value);
+    return i > 0 && index->values[begin + i - 1] == value;
+}
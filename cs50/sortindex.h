@@ -0,0 +1,156 @@
+/**
+ * sortindex.h
+ *
+ * On-disk sorted index for find. A file holds a header, the haystack's
+ * values in sorted order and, optionally, a sparse array of fences, every
+ * fence_stride'th value, to narrow a search down before touching the
+ * values. Opening an index maps it read-only and shared, so there is no
+ * sort at startup and every process searching the same index shares one
+ * copy in the page cache.
+ */
+
+#ifndef SORTINDEX_H
+#define SORTINDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "outbuf.h"
+
+// identifies an index file, and the layout version this code writes
+#define SORTINDEX_MAGIC "FINDIDX"
+#define SORTINDEX_VERSION 1
+
+// default values per fence
+#define SORTINDEX_STRIDE 512
+
+// start of every index file, 64 bytes so the values are cache aligned
+typedef struct
+{
+    char magic[8];              // SORTINDEX_MAGIC
+    uint32_t version;           // SORTINDEX_VERSION
+    uint32_t fence_stride;      // values per fence, 0 if no fences
+    uint64_t count;             // sorted values following the header
+    uint64_t fence_count;       // fences following the values
+    uint64_t checksum;          // of the values then the fences
+    uint8_t reserved[24];
+}
+sortindex_header;
+
+// an open, mapped index
+typedef struct
+{
+    const int *values;
+    size_t count;
+    const int *fences;
+    size_t fence_count;
+    size_t fence_stride;
+    uint64_t checksum;
+    void *map;
+    size_t map_len;
+}
+sortindex;
+
+// an index being written, one run of sorted values at a time
+typedef struct
+{
+    outbuf out;
+    uint64_t count;
+    uint64_t checksum;
+    size_t fence_stride;
+    int *fences;
+    size_t fence_count;
+    size_t fence_cap;
+}
+sortindex_writer;
+
+/**
+ * Starts writing an index to replace path. Nothing appears at path until
+ * sortindex_finish renames the finished index over it, so processes with
+ * the old index mapped carry on reading it undisturbed.
+ *
+ * @param sortindex_writer* w The writer to set up
+ * @param const char* path The file to create
+ * @param size_t fence_stride Values per fence, 0 for no fences
+ *
+ * @return bool false with errno set on failure
+ */
+bool sortindex_begin(sortindex_writer *w, const char *path,
+    size_t fence_stride);
+
+/**
+ * Appends n values, which must be sorted and follow on from those
+ * appended before.
+ *
+ * @param sortindex_writer* w The writer
+ * @param const int* values The values
+ * @param size_t n The number of values
+ *
+ * @return bool false with errno set on failure
+ */
+bool sortindex_append(sortindex_writer *w, const int values[], size_t n);
+
+/**
+ * Writes the fences and header, syncs the file and renames it over the
+ * path given to sortindex_begin. On failure the file is removed.
+ *
+ * @param sortindex_writer* w The writer
+ *
+ * @return bool false with errno set on failure
+ */
+bool sortindex_finish(sortindex_writer *w);
+
+/**
+ * Gives up on an index, removing its file and leaving the path given to
+ * sortindex_begin as it was.
+ *
+ * @param sortindex_writer* w The writer
+ *
+ * @return void
+ */
+void sortindex_abort(sortindex_writer *w);
+
+/**
+ * Writes n sorted values to a new index replacing path.
+ *
+ * @param const char* path The file to create
+ * @param const int* sorted The values, in ascending order
+ * @param size_t n The number of values
+ *
+ * @return bool false with errno set on failure
+ */
+bool sortindex_write(const char *path, const int sorted[], size_t n);
+
+/**
+ * Maps the index at path, checking its header against the file's size
+ * and, if verify is set, its checksum, which reads every page.
+ *
+ * @param sortindex* index The index to fill in
+ * @param const char* path The file to map
+ * @param bool verify Whether to check the checksum
+ *
+ * @return bool false with errno set on failure, EINVAL if not an index
+ */
+bool sortindex_open(sortindex *index, const char *path, bool verify);
+
+/**
+ * Unmaps an index.
+ *
+ * @param sortindex* index The index
+ *
+ * @return void
+ */
+void sortindex_close(sortindex *index);
+
+/**
+ * Returns true if value is in the index, else false.
+ *
+ * @param const sortindex* index The index
+ * @param int value The value to look for
+ *
+ * @return bool Whether it was found
+ */
+bool sortindex_search(const sortindex *index, int value);
+
+#endif
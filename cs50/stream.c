@@ -0,0 +1,207 @@
+/**
+ * stream.c
+ *
+ * Streams a file through a cypher in fixed-size chunks.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stream.h"
+
+/**
+ * Reads up to len bytes into buf. Unless partial is set, only returns
+ * short at end of file. Returns the number of bytes read or -1 on error.
+ */
+static ssize_t read_chunk(int fd, char *buf, size_t len, bool partial)
+{
+    size_t got = 0;
+    while (got < len)
+    {
+        ssize_t n = read(fd, buf + got, len - got);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0)
+        {
+            break;
+        }
+        got += n;
+        if (partial)
+        {
+            break;
+        }
+    }
+    return got;
+}
+
+/**
+ * Transforms a memory-mapped file chunk by chunk, dropping each chunk's
+ * pages once used so resident memory stays at about one chunk.
+ */
+static bool stream_mapped(const char *in, size_t size, outbuf *out,
+    size_t chunk, stream_transform transform, void *state)
+{
+    for (size_t done = 0; done < size; done += chunk)
+    {
+        size_t len = size - done < chunk ? size - done : chunk;
+
+        char *dest = outbuf_reserve(out, len);
+        if (dest == NULL)
+        {
+            return false;
+        }
+        transform(in + done, dest, len, state);
+        if (!outbuf_commit(out, len))
+        {
+            return false;
+        }
+        madvise((void *) (in + done), len, MADV_DONTNEED);
+    }
+    return true;
+}
+
+/**
+ * Transforms whatever can be read from in_fd, one chunk at a time.
+ */
+static bool stream_read(int in_fd, outbuf *out, size_t chunk,
+    stream_transform transform, void *state)
+{
+    while (true)
+    {
+        // read straight into the output buffer and transform in place
+        char *dest = outbuf_reserve(out, chunk);
+        if (dest == NULL)
+        {
+            return false;
+        }
+
+        ssize_t len = read_chunk(in_fd, dest, chunk, out->unbuffered);
+        if (len < 0)
+        {
+            return false;
+        }
+        if (len == 0)
+        {
+            return true;
+        }
+
+        transform(dest, dest, len, state);
+        if (!outbuf_commit(out, len))
+        {
+            return false;
+        }
+    }
+}
+
+/**
+ * Opens in_path, "-" meaning stdin, and maps it if it is a non-empty
+ * regular file. Returns the descriptor, or -1 on error; *map is left
+ * MAP_FAILED if the file should be read instead.
+ */
+static int open_input(const char *in_path, void **map, size_t *size)
+{
+    int fd = strcmp(in_path, "-") == 0 ? STDIN_FILENO
+        : open(in_path, O_RDONLY);
+
+    *map = MAP_FAILED;
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+        && st.st_size > 0)
+    {
+        *size = st.st_size;
+        *map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (*map != MAP_FAILED)
+        {
+            madvise(*map, *size, MADV_SEQUENTIAL);
+        }
+    }
+    return fd;
+}
+
+/**
+ * Unmaps and closes what open_input opened, keeping errno.
+ */
+static void close_input(int fd, void *map, size_t size)
+{
+    int saved = errno;
+    if (map != MAP_FAILED)
+    {
+        munmap(map, size);
+    }
+    if (fd != STDIN_FILENO)
+    {
+        close(fd);
+    }
+    errno = saved;
+}
+
+bool stream_file(const char *in_path, outbuf *out, size_t chunk,
+    stream_transform transform, void *state)
+{
+    void *map;
+    size_t size;
+    int in_fd = open_input(in_path, &map, &size);
+    if (in_fd < 0)
+    {
+        return false;
+    }
+
+    bool ok = map != MAP_FAILED
+        ? stream_mapped(map, size, out, chunk, transform, state)
+        : stream_read(in_fd, out, chunk, transform, state);
+
+    close_input(in_fd, map, size);
+    return ok;
+}
+
+bool stream_scan(const char *in_path, size_t chunk, stream_visit visit,
+    void *state)
+{
+    void *map;
+    size_t size;
+    int in_fd = open_input(in_path, &map, &size);
+    if (in_fd < 0)
+    {
+        return false;
+    }
+
+    bool ok = true;
+    if (map != MAP_FAILED)
+    {
+        const char *in = map;
+        for (size_t done = 0; done < size; done += chunk)
+        {
+            size_t len = size - done < chunk ? size - done : chunk;
+            visit(in + done, len, state);
+            madvise((void *) (in + done), len, MADV_DONTNEED);
+        }
+    }
+    else
+    {
+        char *buf = malloc(chunk);
+        ssize_t len;
+        ok = buf != NULL;
+        while (ok && (len = read_chunk(in_fd, buf, chunk, false)) > 0)
+        {
+            visit(buf, len, state);
+        }
+        ok = ok && len == 0;
+        free(buf);
+    }
+
+    close_input(in_fd, map, size);
+    return ok;
+}
@@ -0,0 +1,64 @@
+/**
+ * stream.h
+ *
+ * Streams a file through a cypher in fixed-size chunks.
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "outbuf.h"
+
+// default bytes transformed per step, bounds the memory used by a stream
+#define STREAM_CHUNK (1 << 20)
+
+/**
+ * Transforms len bytes from in into out. state is whatever the cypher
+ * needs to carry from one chunk to the next, e.g. a key position.
+ * in and out may be the same buffer.
+ */
+typedef void (*stream_transform)(const char *in, char *out, size_t len,
+    void *state);
+
+/**
+ * Runs the file at in_path, "-" meaning stdin, through transform and
+ * appends the result to out. Regular files are memory mapped, anything
+ * else (pipes, terminals) is read in chunk sized pieces; either way the
+ * output is produced straight into out's buffer, so memory use does not
+ * grow with the input. If out is unbuffered, pipes are passed on as soon
+ * as anything can be read rather than a chunk at a time.
+ *
+ * @param const char* in_path The file to read
+ * @param outbuf* out Where to write, with room for at least chunk bytes
+ * @param size_t chunk The most bytes passed to transform at once
+ * @param stream_transform transform The cypher to apply to each chunk
+ * @param void* state Passed through to transform
+ *
+ * @return bool true on success, false with errno set on failure
+ */
+bool stream_file(const char *in_path, outbuf *out, size_t chunk,
+    stream_transform transform, void *state);
+
+/**
+ * Reads len bytes of in without producing output, e.g. to count them.
+ */
+typedef void (*stream_visit)(const char *in, size_t len, void *state);
+
+/**
+ * Passes the file at in_path, "-" meaning stdin, to visit in chunk sized
+ * pieces, reading it exactly once, the same way stream_file does.
+ *
+ * @param const char* in_path The file to read
+ * @param size_t chunk The most bytes passed to visit at once
+ * @param stream_visit visit Called with each chunk in order
+ * @param void* state Passed through to visit
+ *
+ * @return bool true on success, false with errno set on failure
+ */
+bool stream_scan(const char *in_path, size_t chunk, stream_visit visit,
+    void *state);
+
+#endif
@@ -1,36 +1,180 @@
 #include <cs50.h>
 #include <ctype.h>
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
-void encrypt_text(string, string);
+#include "analysis.h"
+#include "cipher.h"
+#include "outbuf.h"
+#include "stream.h"
+
+void encrypt_text(string, vigenere_stream *, outbuf *);
+void encrypt_chunk(const char *, char *, size_t, void *);
+bool crack(string, outbuf *, bool, int, int);
+void collect_letters(const char *, size_t, void *);
+
+// longest key --crack tries by default
+#define MAX_PERIOD 40
+
+// most threads used, as many as cipher.c will split a span across, so
+// that --threads cannot size the stream's chunks past reason
+#define MAX_THREADS 256
+
+// letters of a streamed file, packed one per byte as 0..25
+typedef struct
+{
+    unsigned char *letters;
+    size_t n;
+    size_t cap;
+    bool failed;
+}
+letter_buffer;
 
 int main(int argc, string argv[])
 {
-    // check the number of command-line args equals 2
-    if (argc != 2)
+    string in_path = NULL;    // --in FILE, streams instead of prompting
+    string out_path = NULL;   // --out FILE
+    string key = NULL;        // the key
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    bool unbuffered = false;  // --unbuffered, write output immediately
+    bool cracking = false;    // --crack, find the key of the input
+    bool show = false;        // --show, print the decrypted input too
+    bool decrypt = false;     // --decrypt, undo the cypher
+    int max_period = MAX_PERIOD;
+    
+    // parse command-line args
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--in") == 0 && i + 1 < argc)
+        {
+            in_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+        {
+            out_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--unbuffered") == 0)
+        {
+            unbuffered = true;
+        }
+        else if (strcmp(argv[i], "--crack") == 0)
+        {
+            cracking = true;
+        }
+        else if (strcmp(argv[i], "--show") == 0)
+        {
+            show = true;
+        }
+        else if (strcmp(argv[i], "--decrypt") == 0)
+        {
+            decrypt = true;
+        }
+        else if (strcmp(argv[i], "--max-period") == 0 && i + 1 < argc)
+        {
+            max_period = atoi(argv[++i]);
+        }
+        else if (key == NULL)
+        {
+            key = argv[i];
+        }
+        else
+        {
+            printf("Error! One key required, %d given.\n", argc - 1);
+            return 1;
+        }
+    }
+    
+    // check a key was given, or --crack instead of one
+    if (cracking ? key != NULL || max_period < 1 : key == NULL || key[0] == '\0')
     {
-        printf("Error! One argument required, %d given.\n", argc - 1);
+        printf("Usage: ./vigenere [--decrypt] [--in FILE] [--out FILE] [--threads N] [--unbuffered] key\n");
+        printf("       ./vigenere --crack [--show] [--max-period N] [--in FILE] [--out FILE] [--threads N]\n");
         return 1;
     }
     
     // make sure input contains only alphabetical characters
-    for (int i = 0, len = strlen(argv[1]); i < len; i++)
+    for (int i = 0, len = cracking ? 0 : strlen(key); i < len; i++)
     {
-        if (! isalpha(argv[1][i]))
+        if (! isalpha(key[i]))
         {
             printf("Error! argument must only contain alphabetical characters.\n");
             return 1;
         }
     }
     
+    if (threads < 1)
+    {
+        threads = 1;
+    }
+    else if (threads > MAX_THREADS)
+    {
+        threads = MAX_THREADS;
+    }
+    
+    // stream in chunks big enough to keep every thread busy
+    size_t chunk = threads > 1 ? (size_t) threads * 4 * STREAM_CHUNK : STREAM_CHUNK;
+    
+    // all output goes through one buffer
+    outbuf out;
+    if (!outbuf_open(&out, out_path ? out_path : "-", chunk, unbuffered))
+    {
+        printf("Error! %s\n", strerror(errno));
+        return 1;
+    }
+    
+    // recover an unknown key
+    if (cracking)
+    {
+        if (!crack(in_path ? in_path : "-", &out, show, max_period, threads)
+            || !outbuf_close(&out))
+        {
+            printf("Error! %s\n", strerror(errno));
+            return 1;
+        }
+        return 0;
+    }
+    
+    // compile the key once, up front
+    vigenere_stream stream;
+    if (!vigenere_stream_init(&stream, key, decrypt))
+    {
+        printf("Error! %s\n", strerror(errno));
+        return 1;
+    }
+    stream.threads = threads;
+    
+    // stream a whole file, "-" meaning stdin
+    if (in_path != NULL || out_path != NULL)
+    {
+        if (!stream_file(in_path ? in_path : "-", &out, chunk, encrypt_chunk,
+            &stream) || !outbuf_close(&out))
+        {
+            printf("Error! %s\n", strerror(errno));
+            return 1;
+        }
+        return 0;
+    }
+    
     // get message to encrypt from the user
     string message = GetString();
+    if (message == NULL)
+    {
+        outbuf_close(&out);
+        return 1;
+    }
     
     // encrypt the message
-    encrypt_text(message, argv[1]);
+    encrypt_text(message, &stream, &out);
     
-    printf("\n");
+    outbuf_append(&out, "\n", 1);
+    outbuf_close(&out);
     
     return 0;
 }
@@ -40,76 +184,139 @@ int main(int argc, string argv[])
  * Encrypts a message using vigenere cypher
  *
  * @param string message The message to be encrypted
- * @param string key The key to use for the cypher
+ * @param vigenere_stream* stream The cypher to use, from its first letter
+ * @param outbuf* out Where to write the encrypted message
  *
  * @return void
  */
- void encrypt_text(string message, string key)
+ void encrypt_text(string message, vigenere_stream *stream, outbuf *out)
  {
-    char alphabet[] = {'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i',
-    'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v',
-    'w', 'x', 'y', 'z'};
+    size_t len = strlen(message); // length of the message
     
-    char encrypted_text[strlen(message)]; // array for the encrypted message
-    int key_length = strlen(key);         // length of the key
-    int message_val;                      // current alphabet value of message
-    int key_val;                          // current alphabet value of key
-    int char_count = 0;                   // current key count
+    // encrypt the whole message at once, in place
+    vigenere_stream_apply(stream, message, len);
     
-    for (int i = 0, len = strlen(message); i < len; i++)
+    // write the encrypted text out
+    outbuf_append(out, message, len);
+ }
+
+/**
+ * Encrypts one chunk of a streamed file, carrying the key position over
+ * to the next chunk
+ *
+ * @param const char* in The chunk to be encrypted
+ * @param char* out Where to store the encrypted chunk
+ * @param size_t len The size of the chunk
+ * @param void* stream Points to the vigenere_stream
+ *
+ * @return void
+ */
+ void encrypt_chunk(const char *in, char *out, size_t len, void *stream)
+ {
+    vigenere_stream_update(stream, in, out, len);
+ }
+
+/**
+ * Finds the key a file was most likely encrypted with, reading it once.
+ * The key is written to out, or with show to stderr followed by the
+ * decrypted file to out, which needs a second pass and so a file that
+ * can be read again.
+ *
+ * @param string in_path The file to crack, "-" meaning stdin
+ * @param outbuf* out Where to write the key or decrypted text
+ * @param bool show Whether to write the decrypted text
+ * @param int max_period The longest key to try
+ * @param int threads The number of threads to use
+ *
+ * @return bool false with errno set on failure
+ */
+ bool crack(string in_path, outbuf *out, bool show, int max_period, int threads)
+ {
+    // a pipe cannot be read twice
+    bool from_stdin = strcmp(in_path, "-") == 0;
+    if (show && from_stdin && lseek(STDIN_FILENO, 0, SEEK_CUR) < 0)
     {
-        if (isalpha(message[i]))
-        {
-            // map ascii values to alphabet values
-            for (int j = 0; j < 26; j++)
-            {
-                // map message ascii value to alphabet value
-                if (tolower(message[i]) == alphabet[j])
-                {
-                    message_val = j;
-                }
-                
-                // map key ascii value to alphabet value
-                if (tolower(key[char_count % key_length]) == alphabet[j])
-                {
-                    key_val = j;
-                }
-            }
-            
-            if (message_val + key_val < 26)
-            {
-                // get the current cypher character if the alphabet does not wrap
-                if (islower(message[i]))
-                {
-                    encrypted_text[i] =  alphabet[message_val + key_val];
-                }
-                else
-                {
-                    encrypted_text[i] = toupper(alphabet[message_val + key_val]); 
-                }
-            }
-            else
-            {
-                // get the current cypher character if the alphabet does wrap
-                if (islower(message[i]))
-                {
-                    encrypted_text[i] = alphabet[(message_val + key_val) % 26];
-                }
-                else
-                {
-                    encrypted_text[i] = toupper(alphabet[(message_val + key_val) % 26]);
-                }
-            }
-            // increment the value of key[char_count]
-            char_count++;
-        } 
-        else
+        return false;
+    }
+    
+    letter_buffer buffer = {NULL, 0, 0, false};
+    if (!stream_scan(in_path, STREAM_CHUNK, collect_letters, &buffer) || buffer.failed)
+    {
+        free(buffer.letters);
+        return false;
+    }
+    
+    // no key is longer than the text, and --max-period may be anything
+    if ((size_t) max_period > buffer.n)
+    {
+        max_period = buffer.n > 0 ? buffer.n : 1;
+    }
+    char *key = malloc(max_period + 1);
+    int period = key == NULL ? 0
+        : crack_vigenere(buffer.letters, buffer.n, max_period, threads, key);
+    free(buffer.letters);
+    if (period == 0)
+    {
+        free(key);
+        errno = buffer.n == 0 ? EINVAL : ENOMEM;
+        return false;
+    }
+    
+    if (!show)
+    {
+        bool ok = outbuf_append(out, key, period) && outbuf_append(out, "\n", 1);
+        free(key);
+        return ok;
+    }
+    
+    fprintf(stderr, "key: %s\n", key);
+    
+    vigenere_stream stream;
+    if ((from_stdin && lseek(STDIN_FILENO, 0, SEEK_SET) != 0)
+        || !vigenere_stream_init(&stream, key, true))
+    {
+        int saved = errno;
+        free(key);
+        errno = saved;
+        return false;
+    }
+    free(key);
+    stream.threads = threads;
+    bool ok = stream_file(in_path, out, out->cap, encrypt_chunk, &stream);
+    vigenere_stream_free(&stream);
+    return ok;
+ }
+
+/**
+ * Appends the letters of one chunk of a streamed file to a letter_buffer
+ *
+ * @param const char* in The chunk
+ * @param size_t len The size of the chunk
+ * @param void* buffer Points to the letter_buffer
+ *
+ * @return void
+ */
+ void collect_letters(const char *in, size_t len, void *buffer)
+ {
+    letter_buffer *b = buffer;
+    if (b->failed)
+    {
+        return;
+    }
+    
+    // make room for the worst case, every byte a letter
+    if (b->cap - b->n < len)
+    {
+        size_t cap = b->cap * 2 > b->n + len ? b->cap * 2 : b->n + len;
+        unsigned char *letters = realloc(b->letters, cap);
+        if (letters == NULL)
         {
-            // copy message[i] if it is not alphabetical
-            encrypted_text[i] = message[i];
+            b->failed = true;
+            return;
         }
-        
-        // print the encrypted text to the screen
-        printf("%c", encrypted_text[i]);
+        b->letters = letters;
+        b->cap = cap;
     }
+    
+    b->n += letter_values(in, len, b->letters + b->n);
  }